@@ -0,0 +1,40 @@
+#include <time.h>
+
+#include "config_epoch.h"
+
+#define SYNC_SLEEP_NS (100 * 1000)
+
+int ConfigEpochEnter(ConfigEpoch *epoch)
+{
+	while (1)
+	{
+		// 登记后epoch未变，说明发布方翻转epoch前已经能看到登记
+		unsigned int current = __atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST);
+		int index = current & 1;
+		__atomic_add_fetch(&epoch->readerCnt[index], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST) == current)
+		{
+			return index;
+		}
+		__atomic_sub_fetch(&epoch->readerCnt[index], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void ConfigEpochExit(ConfigEpoch *epoch, int token)
+{
+	__atomic_sub_fetch(&epoch->readerCnt[token & 1], 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * 翻转epoch后，新的读取方登记在另一个计数中，并且一定读到新的指针，
+ * 所以只需要等待旧的计数归零
+ */
+void ConfigEpochSynchronize(ConfigEpoch *epoch)
+{
+	unsigned int old = __atomic_fetch_add(&epoch->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+	while (__atomic_load_n(&epoch->readerCnt[old], __ATOMIC_SEQ_CST) != 0)
+	{
+		struct timespec ts = {0, SYNC_SLEEP_NS};
+		nanosleep(&ts, NULL);
+	}
+}
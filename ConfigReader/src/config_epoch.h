@@ -0,0 +1,27 @@
+#ifndef _CONFIG_EPOCH_H
+#define _CONFIG_EPOCH_H
+
+/*
+ * 读取方无锁登记，发布方交换指针后等待交换前登记的读取方全部退出，之后旧数据可以安全释放
+ * 读取方按epoch的奇偶登记到两个计数中，ConfigReloader和ConfigLayers共用
+ * 全部清零即为初始状态
+ */
+typedef struct ConfigEpoch
+{
+	unsigned int epoch;		// 读取方按epoch的奇偶登记到readerCnt中
+	int readerCnt[2];		// 两个奇偶期中的读取方数量
+}ConfigEpoch;
+
+/*
+ * 登记一个读取方，登记后读到的指针在ConfigEpochExit前不会被释放
+ * @return 传给ConfigEpochExit的token
+ */
+int ConfigEpochEnter(ConfigEpoch *epoch);
+void ConfigEpochExit(ConfigEpoch *epoch, int token);
+
+/*
+ * 等待所有在调用前登记的读取方Exit，多个发布方之间需要调用方串行化
+ */
+void ConfigEpochSynchronize(ConfigEpoch *epoch);
+
+#endif
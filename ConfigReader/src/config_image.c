@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config_reader.h"
+#include "config_image.h"
+
+#define IMAGE_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+#define IMAGE_MIN_SLOTS 16
+#define IMAGE_MAX_STRING_SIZE 0xFFFFFFFFULL
+
+static uint32_t ConfigImageChecksum(const char *data, uint64_t len)
+{
+	uint32_t hash = 2166136261U;
+	const unsigned char *pc = (const unsigned char*)data;
+	const unsigned char *end = pc + len;
+	while (pc < end)
+	{
+		hash = (hash ^ *pc++) * 16777619U;
+	}
+	return hash;
+}
+
+static const ConfigImageSection* ImageSections(const ConfigImageHeader *image)
+{
+	return (const ConfigImageSection*)((const char*)image + image->sectionOffset);
+}
+
+static const ConfigImageKv* ImageKvs(const ConfigImageHeader *image)
+{
+	return (const ConfigImageKv*)((const char*)image + image->kvOffset);
+}
+
+static const ConfigImageSlot* ImageSlots(const ConfigImageHeader *image)
+{
+	return (const ConfigImageSlot*)((const char*)image + image->slotOffset);
+}
+
+/*
+ * 取出字符串池中的字符串，偏移越界时返回""，镜像损坏也不会越界访问
+ */
+static const char* ImageString(const ConfigImageHeader *image, uint32_t offset)
+{
+	if (offset >= image->stringSize)
+	{
+		return "";
+	}
+	return (const char*)image + image->stringOffset + offset;
+}
+
+/*
+ * 把字符串追加到字符串池
+ * @return 字符串在池中的偏移
+ */
+static uint32_t ImageAddString(char *pool, uint64_t *used, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t offset = (uint32_t)*used;
+	memcpy(pool + *used, str, len);
+	*used += len;
+	return offset;
+}
+
+/*
+ * 把镜像写入唯一的临时文件，落盘后再重命名，已经映射旧镜像的进程不受影响，
+ * 同时保存的多个进程也不会写同一个临时文件，掉电后不会留下不完整的镜像
+ */
+static int ConfigImageSave(const char *fileName, const char *data, uint64_t len)
+{
+	size_t nameLen = strlen(fileName);
+	char *tmpName = (char*)malloc(nameLen + 8);
+	if (tmpName == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+	memcpy(tmpName, fileName, nameLen);
+	memcpy(tmpName + nameLen, ".XXXXXX", 8);
+
+	int ret = 0;
+	int fd = mkstemp(tmpName);
+	if (fd < 0)
+	{
+		free(tmpName);
+		return ERR_WRITE_IMAGE;
+	}
+
+	uint64_t written = 0;
+	while (written < len)
+	{
+		ssize_t n = write(fd, data + written, len - written);
+		if (n <= 0)
+		{
+			ret = ERR_WRITE_IMAGE;
+			break;
+		}
+		written += n;
+	}
+
+	// mkstemp创建的文件只有属主可读，镜像需要给其他进程映射
+	if (ret == 0 && (fchmod(fd, 0644) != 0 || fsync(fd) != 0))
+	{
+		ret = ERR_WRITE_IMAGE;
+	}
+
+	if (close(fd) != 0 || ret != 0 || rename(tmpName, fileName) != 0)
+	{
+		unlink(tmpName);
+		ret = ERR_WRITE_IMAGE;
+	}
+	free(tmpName);
+	return ret;
+}
+
+int ConfigReaderWriteImage(const ConfigReader *reader, const char *fileName)
+{
+	if (reader == NULL || fileName == NULL)
+	{
+		return ERR_CONFIG_NULL;
+	}
+
+	if (reader->image != NULL)
+	{
+		// 由镜像打开的reader直接复制镜像
+		return ConfigImageSave(fileName, reader->source, reader->sourceLen);
+	}
+
+	uint64_t kvCount = 0;
+	uint64_t stringSize = 0;
+	int i = 0;
+	int j = 0;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		// 延迟解析的reader先解析所有section
+		int ret = ConfigReaderLoadSection(reader, reader->sections[i].name);
+		if (ret != 0)
+		{
+			return ret;
+		}
+	}
+
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		const ConfigSection *section = reader->sections + i;
+		stringSize += strlen(section->name) + 1;
+		for (j = 0; j < section->kvCount; ++j)
+		{
+			stringSize += strlen(section->kvs[j].key) + strlen(section->kvs[j].value) + 2;
+		}
+		kvCount += section->kvCount;
+	}
+
+	if (stringSize > IMAGE_MAX_STRING_SIZE)
+	{
+		return ERR_IMAGE_FORMAT;
+	}
+
+	uint64_t slotCount = IMAGE_MIN_SLOTS;
+	while (slotCount < kvCount * 2)
+	{
+		slotCount *= 2;
+	}
+
+	ConfigImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONFIG_IMAGE_MAGIC, sizeof(header.magic));
+	header.version = CONFIG_IMAGE_VERSION;
+	header.headerSize = sizeof(ConfigImageHeader);
+	header.sectionCount = reader->sectionCount;
+	header.kvCount = (uint32_t)kvCount;
+	header.slotCount = (uint32_t)slotCount;
+	header.sectionOffset = IMAGE_ALIGN(sizeof(ConfigImageHeader));
+	header.kvOffset = IMAGE_ALIGN(header.sectionOffset + sizeof(ConfigImageSection) * header.sectionCount);
+	header.slotOffset = IMAGE_ALIGN(header.kvOffset + sizeof(ConfigImageKv) * kvCount);
+	header.stringOffset = IMAGE_ALIGN(header.slotOffset + sizeof(ConfigImageSlot) * slotCount);
+	header.stringSize = stringSize;
+	header.imageSize = header.stringOffset + stringSize;
+
+	char *data = (char*)calloc(1, header.imageSize);
+	if (data == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+
+	ConfigImageSection *sections = (ConfigImageSection*)(data + header.sectionOffset);
+	ConfigImageKv *kvs = (ConfigImageKv*)(data + header.kvOffset);
+	ConfigImageSlot *slots = (ConfigImageSlot*)(data + header.slotOffset);
+	char *pool = data + header.stringOffset;
+	uint64_t used = 0;
+	uint32_t kvIndex = 0;
+	uint32_t mask = header.slotCount - 1;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		const ConfigSection *section = reader->sections + i;
+		sections[i].name = ImageAddString(pool, &used, section->name);
+		sections[i].kvBegin = kvIndex;
+		sections[i].kvCount = section->kvCount;
+		for (j = 0; j < section->kvCount; ++j, ++kvIndex)
+		{
+			const ConfigKeyValue *kv = section->kvs + j;
+			kvs[kvIndex].key = ImageAddString(pool, &used, kv->key);
+			kvs[kvIndex].value = ImageAddString(pool, &used, kv->value);
+
+			// 与内存索引相同，重复的(section, key)只索引第一个
+			unsigned int hash = ConfigIndexHash(section->name, kv->key);
+			uint32_t k = hash & mask;
+			while (slots[k].kv != 0)
+			{
+				if (slots[k].hash == hash && strcmp(pool + kvs[slots[k].kv - 1].key, kv->key) == 0
+					&& strcmp(pool + sections[slots[k].section].name, section->name) == 0)
+				{
+					break;
+				}
+				k = (k + 1) & mask;
+			}
+
+			if (slots[k].kv == 0)
+			{
+				slots[k].hash = hash;
+				slots[k].section = i;
+				slots[k].kv = kvIndex + 1;
+			}
+		}
+	}
+
+	header.checksum = ConfigImageChecksum(data + header.headerSize, header.imageSize - header.headerSize);
+	memcpy(data, &header, sizeof(header));
+
+	int ret = ConfigImageSave(fileName, data, header.imageSize);
+	free(data);
+	return ret;
+}
+
+/*
+ * 检查头部和各个表的范围，只读取头部，不会访问整个镜像
+ */
+/*
+ * 检查count个size字节的元素从offset开始时位于头部之后、文件之内，比较时不会溢出
+ */
+static int ImageRangeValid(uint64_t offset, uint64_t size, uint64_t count, uint64_t fileSize)
+{
+	return offset >= sizeof(ConfigImageHeader) && offset <= fileSize
+		&& count <= (fileSize - offset) / size;
+}
+
+static int ConfigImageCheck(const ConfigImageHeader *image, uint64_t fileSize)
+{
+	if (fileSize < sizeof(ConfigImageHeader)
+		|| memcmp(image->magic, CONFIG_IMAGE_MAGIC, sizeof(image->magic)) != 0
+		|| image->version != CONFIG_IMAGE_VERSION
+		|| image->headerSize != sizeof(ConfigImageHeader)
+		|| image->imageSize != fileSize
+		|| image->sectionCount > 0x7FFFFFFF)
+	{
+		return ERR_IMAGE_FORMAT;
+	}
+
+	if (image->slotCount == 0 || (image->slotCount & (image->slotCount - 1)) != 0)
+	{
+		return ERR_IMAGE_FORMAT;
+	}
+
+	if (!ImageRangeValid(image->sectionOffset, sizeof(ConfigImageSection), image->sectionCount, fileSize)
+		|| !ImageRangeValid(image->kvOffset, sizeof(ConfigImageKv), image->kvCount, fileSize)
+		|| !ImageRangeValid(image->slotOffset, sizeof(ConfigImageSlot), image->slotCount, fileSize)
+		|| !ImageRangeValid(image->stringOffset, 1, image->stringSize, fileSize)
+		|| image->stringSize == 0 || image->stringSize > IMAGE_MAX_STRING_SIZE
+		|| image->stringSize != fileSize - image->stringOffset)
+	{
+		return ERR_IMAGE_FORMAT;
+	}
+
+	// 最后一个字符串必须以'\0'结尾，否则字符串可能越过镜像的末尾
+	const char *pool = (const char*)image + image->stringOffset;
+	if (pool[image->stringSize - 1] != '\0')
+	{
+		return ERR_IMAGE_FORMAT;
+	}
+	return 0;
+}
+
+ConfigReader* ConfigReaderOpenImage(const char *fileName, int flags, int *errNo)
+{
+	if (fileName == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_CONFIG_NULL;
+		return NULL;
+	}
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		if (errNo != NULL) *errNo = ERR_OPEN_CONFIG;
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ConfigImageHeader))
+	{
+		if (errNo != NULL) *errNo = ERR_IMAGE_FORMAT;
+		close(fd);
+		return NULL;
+	}
+
+	// 共享映射，同一个镜像在所有进程间共享页缓存
+	size_t len = st.st_size;
+	void *addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		if (errNo != NULL) *errNo = ERR_OPEN_CONFIG;
+		return NULL;
+	}
+
+	const ConfigImageHeader *image = (const ConfigImageHeader*)addr;
+	int ret = ConfigImageCheck(image, len);
+	if (ret == 0 && (flags & CONFIG_READER_VERIFY_IMAGE))
+	{
+		uint32_t checksum = ConfigImageChecksum((const char*)addr + image->headerSize,
+			image->imageSize - image->headerSize);
+		ret = checksum == image->checksum ? 0 : ERR_IMAGE_CHECKSUM;
+	}
+
+	// handle所需的kv表在第一次查找handle时才分配，打开镜像不分配与kv数成正比的内存
+	ConfigReader *reader = NULL;
+	if (ret == 0)
+	{
+		reader = (ConfigReader*)calloc(1, sizeof(ConfigReader));
+		if (reader == NULL)
+		{
+			ret = ERR_MALLOC_FAILED;
+		}
+	}
+
+	if (ret != 0)
+	{
+		if (errNo != NULL) *errNo = ret;
+		munmap(addr, len);
+		return NULL;
+	}
+
+	reader->image = image;
+	reader->source = (char*)addr;
+	reader->sourceLen = len;
+	reader->sectionCount = image->sectionCount;
+	return reader;
+}
+
+/*
+ * @return kv在kv表中的下标，不存在返回-1
+ */
+static int ConfigImageFind(const ConfigImageHeader *image, const char *sectionName, const char *key)
+{
+	const ConfigImageSection *sections = ImageSections(image);
+	const ConfigImageKv *kvs = ImageKvs(image);
+	const ConfigImageSlot *slots = ImageSlots(image);
+	unsigned int hash = ConfigIndexHash(sectionName, key);
+	uint32_t mask = image->slotCount - 1;
+	uint32_t i = hash & mask;
+	uint32_t probes = 0;
+	for (probes = 0; probes < image->slotCount && slots[i].kv != 0; ++probes)
+	{
+		const ConfigImageSlot *slot = slots + i;
+		if (slot->hash == hash && slot->kv <= image->kvCount && slot->section < image->sectionCount
+			&& strcmp(ImageString(image, kvs[slot->kv - 1].key), key) == 0
+			&& strcmp(ImageString(image, sections[slot->section].name), sectionName) == 0)
+		{
+			return (int)(slot->kv - 1);
+		}
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
+
+const char* ConfigImageGetValue(const ConfigReader *reader, const char *sectionName, const char *key)
+{
+	int i = ConfigImageFind(reader->image, sectionName, key);
+	if (i < 0)
+	{
+		return "";
+	}
+	return ImageString(reader->image, ImageKvs(reader->image)[i].value);
+}
+
+/*
+ * 第一次查找handle时分配kv表，多个线程同时分配时只保留先发布的一个
+ */
+static ConfigKeyValue* ConfigImageKvTable(const ConfigReader *reader)
+{
+	ConfigKeyValue **table = (ConfigKeyValue**)&reader->allKvs;
+	ConfigKeyValue *kvs = __atomic_load_n(table, __ATOMIC_ACQUIRE);
+	if (kvs != NULL)
+	{
+		return kvs;
+	}
+
+	ConfigKeyValue *created = (ConfigKeyValue*)calloc(reader->image->kvCount, sizeof(ConfigKeyValue));
+	if (created == NULL)
+	{
+		return NULL;
+	}
+
+	if (!__atomic_compare_exchange_n(table, &kvs, created, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		free(created);
+		return kvs;
+	}
+	return created;
+}
+
+const ConfigKeyValue* ConfigImageLookupHandle(const ConfigReader *reader,
+	const char *sectionName, const char *key)
+{
+	const ConfigImageHeader *image = reader->image;
+	int i = ConfigImageFind(image, sectionName, key);
+	if (i < 0)
+	{
+		return &ConfigKeyValueMissing;
+	}
+
+	ConfigKeyValue *kvs = ConfigImageKvTable(reader);
+	if (kvs == NULL)
+	{
+		return &ConfigKeyValueMissing;
+	}
+
+	// 多个线程同时填写时写入的是相同的值，key最后写入作为已填写的标记
+	ConfigKeyValue *kv = kvs + i;
+	if (__atomic_load_n(&kv->key, __ATOMIC_ACQUIRE) == NULL)
+	{
+		const ConfigImageKv *imageKv = ImageKvs(image) + i;
+		__atomic_store_n(&kv->value, ImageString(image, imageKv->value), __ATOMIC_RELAXED);
+		__atomic_store_n(&kv->key, ImageString(image, imageKv->key), __ATOMIC_RELEASE);
+	}
+	return kv;
+}
+
+int ConfigImageFindSection(const ConfigReader *reader, const char *sectionName)
+{
+	// section表按名字排序写入，与ConfigReaderSort的结果相同
+	const ConfigImageHeader *image = reader->image;
+	const ConfigImageSection *sections = ImageSections(image);
+	int begin = 0;
+	int end = (int)image->sectionCount - 1;
+	while (begin <= end)
+	{
+		int middle = begin + (end - begin) / 2;
+		int ret = strcmp(ImageString(image, sections[middle].name), sectionName);
+		if (ret == 0)
+		{
+			return middle;
+		}
+		else if (ret < 0)
+		{
+			begin = middle + 1;
+		}
+		else
+		{
+			end = middle - 1;
+		}
+	}
+	return -1;
+}
+
+void ConfigImagePrint(const ConfigReader *reader)
+{
+	const ConfigImageHeader *image = reader->image;
+	const ConfigImageSection *sections = ImageSections(image);
+	const ConfigImageKv *kvs = ImageKvs(image);
+	uint32_t i = 0;
+	for (i = 0; i < image->sectionCount; ++i)
+	{
+		const ConfigImageSection *section = sections + i;
+		printf("[%s]\n", ImageString(image, section->name));
+		uint32_t j = 0;
+		for (j = section->kvBegin; j < image->kvCount && j - section->kvBegin < section->kvCount; ++j)
+		{
+			printf("%s=%s\n", ImageString(image, kvs[j].key), ImageString(image, kvs[j].value));
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef _CONFIG_IMAGE_H
+#define _CONFIG_IMAGE_H
+
+#include <stdint.h>
+
+#include "config_reader.h"
+
+#define CONFIG_IMAGE_MAGIC "CFGIMAGE"
+#define CONFIG_IMAGE_VERSION 1
+
+/*
+ * 二进制配置镜像，所有位置都是相对镜像起始地址的偏移，与映射地址无关
+ * 布局：头部 | section表 | kv表 | (section, key)索引 | 字符串池
+ * section和kv表与ConfigReaderSort的结果顺序相同，字符串以'\0'结尾
+ */
+typedef struct ConfigImageHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t imageSize;
+	uint32_t checksum;		// [headerSize, imageSize)的FNV-1a
+	uint32_t sectionCount;
+	uint32_t kvCount;
+	uint32_t slotCount;		// 索引的槽数，2的幂
+	uint64_t sectionOffset;
+	uint64_t kvOffset;
+	uint64_t slotOffset;
+	uint64_t stringOffset;
+	uint64_t stringSize;
+}ConfigImageHeader;
+
+typedef struct ConfigImageSection
+{
+	uint32_t name;		// 字符串池中的偏移
+	uint32_t kvBegin;	// 第一个kv在kv表中的下标
+	uint32_t kvCount;
+	uint32_t reserved;
+}ConfigImageSection;
+
+typedef struct ConfigImageKv
+{
+	uint32_t key;
+	uint32_t value;
+}ConfigImageKv;
+
+typedef struct ConfigImageSlot
+{
+	uint32_t hash;
+	uint32_t section;	// section的下标
+	uint32_t kv;		// kv的下标+1，0表示空槽
+}ConfigImageSlot;
+
+/*
+ * (section, key)的hash，内存索引和镜像索引共用
+ */
+unsigned int ConfigIndexHash(const char *sectionName, const char *key);
+
+/*
+ * 镜像reader的查找和打印，由config_reader.c按reader->image分派
+ */
+const char* ConfigImageGetValue(const ConfigReader *reader, const char *sectionName, const char *key);
+const ConfigKeyValue* ConfigImageLookupHandle(const ConfigReader *reader,
+	const char *sectionName, const char *key);
+void ConfigImagePrint(const ConfigReader *reader);
+/*
+ * @return section在镜像section表中的下标，不存在返回-1
+ */
+int ConfigImageFindSection(const ConfigReader *reader, const char *sectionName);
+
+#endif
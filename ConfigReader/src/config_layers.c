@@ -0,0 +1,93 @@
+#include <stdlib.h>
+
+#include "config_layers.h"
+#include "config_epoch.h"
+
+struct ConfigLayers
+{
+	const ConfigReader *readers[CONFIG_LAYERS_MAX];	// 下标0为基础层，原子读写
+	int count;										// 原子读写
+	ConfigEpoch epoch;								// Acquire和Release之间的读取方
+};
+
+ConfigLayers* ConfigLayersCreate(int *errNo)
+{
+	ConfigLayers *layers = (ConfigLayers*)calloc(1, sizeof(ConfigLayers));
+	if (layers == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		return NULL;
+	}
+	return layers;
+}
+
+void ConfigLayersDestory(ConfigLayers *layers)
+{
+	free(layers);
+}
+
+int ConfigLayersPush(ConfigLayers *layers, const ConfigReader *reader)
+{
+	if (layers == NULL || reader == NULL)
+	{
+		return ERR_CONFIG_NULL;
+	}
+
+	int index = layers->count;
+	if (index >= CONFIG_LAYERS_MAX)
+	{
+		return ERR_TOO_MANY_LAYERS;
+	}
+
+	// 先写reader再增加层数，并发的查找不会看到空的层
+	__atomic_store_n(&layers->readers[index], reader, __ATOMIC_RELEASE);
+	__atomic_store_n(&layers->count, index + 1, __ATOMIC_RELEASE);
+	return index;
+}
+
+const ConfigReader* ConfigLayersReplace(ConfigLayers *layers, int index, const ConfigReader *reader)
+{
+	if (layers == NULL || reader == NULL || index < 0 || index >= layers->count)
+	{
+		return NULL;
+	}
+
+	// 等待所有在交换前Acquire的读取方Release，之后没有人再引用旧的reader
+	const ConfigReader *old = __atomic_exchange_n(&layers->readers[index], reader, __ATOMIC_SEQ_CST);
+	ConfigEpochSynchronize(&layers->epoch);
+	return old;
+}
+
+int ConfigLayersAcquire(ConfigLayers *layers)
+{
+	return ConfigEpochEnter(&layers->epoch);
+}
+
+void ConfigLayersRelease(ConfigLayers *layers, int token)
+{
+	ConfigEpochExit(&layers->epoch, token);
+}
+
+int ConfigLayersGetCount(const ConfigLayers *layers)
+{
+	return layers != NULL ? __atomic_load_n(&layers->count, __ATOMIC_ACQUIRE) : 0;
+}
+
+const ConfigKeyValue* ConfigLayersLookupHandle(const ConfigLayers *layers,
+	const char *sectionName, const char *key, int *layer)
+{
+	int i = ConfigLayersGetCount(layers) - 1;
+	for (; i >= 0; --i)
+	{
+		const ConfigReader *reader = __atomic_load_n(&layers->readers[i], __ATOMIC_SEQ_CST);
+		const ConfigKeyValue *handle = ConfigReaderLookupHandle(reader, sectionName, key);
+		if (!ConfigHandleIsMissing(handle))
+		{
+			if (layer != NULL) *layer = i;
+			return handle;
+		}
+	}
+
+	if (layer != NULL) *layer = -1;
+	return &ConfigKeyValueMissing;
+}
@@ -0,0 +1,72 @@
+#ifndef _CONFIG_LAYERS_H
+#define _CONFIG_LAYERS_H
+
+#include "config_reader.h"
+
+#define CONFIG_LAYERS_MAX 16
+#define ERR_TOO_MANY_LAYERS -1012
+
+/*
+ * 分层配置，按层叠加多个ConfigReader，如基础配置、地域配置和主机配置
+ * 查找时从最上层开始，第一个存在该(section, key)的层生效，value为空也算存在；
+ * 各层不复制也不重新排序，返回的handle直接指向所在层的kv
+ * 各层的reader由调用方创建和销毁，同一个基础reader可以被多个分层配置共享
+ * 查找可以与Push、Replace并发，Push和Replace之间需要调用方串行化；
+ * 与Replace并发的查找需要在Acquire和Release之间进行，被替换的reader在Replace返回后即可销毁
+ */
+typedef struct ConfigLayers ConfigLayers;
+
+ConfigLayers* ConfigLayersCreate(int *errNo);
+
+/*
+ * 只释放分层结构，不销毁各层的reader
+ */
+void ConfigLayersDestory(ConfigLayers *layers);
+
+/*
+ * 在最上面增加一层
+ * @return 层的下标，基础层为0；失败时返回ERR_CONFIG_NULL或ERR_TOO_MANY_LAYERS
+ */
+int ConfigLayersPush(ConfigLayers *layers, const ConfigReader *reader);
+
+/*
+ * 替换一层，通常用于重新加载较小的覆盖层，其他层不受影响
+ * 替换是原子的，返回前等待替换前Acquire的读取方全部Release，返回后旧的reader可以立即销毁；
+ * 不能在同一线程的Acquire和Release之间调用，否则会一直等待
+ * @return 被替换的reader，下标无效时返回NULL
+ */
+const ConfigReader* ConfigLayersReplace(ConfigLayers *layers, int index, const ConfigReader *reader);
+
+/*
+ * 登记读取方，查找得到的handle和value在Release前一直有效，Acquire和Release之间无锁
+ * @return 传给ConfigLayersRelease的token
+ */
+int ConfigLayersAcquire(ConfigLayers *layers);
+void ConfigLayersRelease(ConfigLayers *layers, int token);
+
+int ConfigLayersGetCount(const ConfigLayers *layers);
+
+/*
+ * 从上往下查找(section, key)
+ * @param layer 不为NULL时返回找到的层的下标，不存在时为-1
+ * @return 不存在时返回&ConfigKeyValueMissing
+ */
+const ConfigKeyValue* ConfigLayersLookupHandle(const ConfigLayers *layers,
+	const char *sectionName, const char *key, int *layer);
+
+#define ConfigLayersGetValue(layers, section, key) \
+	ConfigHandleValue(ConfigLayersLookupHandle(layers, section, key, NULL))
+#define ConfigLayersGetInt64(layers, section, key, defaultValue, errNo) \
+	ConfigHandleGetInt64(ConfigLayersLookupHandle(layers, section, key, NULL), defaultValue, errNo)
+#define ConfigLayersGetDouble(layers, section, key, defaultValue, errNo) \
+	ConfigHandleGetDouble(ConfigLayersLookupHandle(layers, section, key, NULL), defaultValue, errNo)
+#define ConfigLayersGetBool(layers, section, key, defaultValue, errNo) \
+	ConfigHandleGetBool(ConfigLayersLookupHandle(layers, section, key, NULL), defaultValue, errNo)
+#define ConfigLayersGetDurationMs(layers, section, key, defaultValue, errNo) \
+	ConfigHandleGetDurationMs(ConfigLayersLookupHandle(layers, section, key, NULL), defaultValue, errNo)
+#define ConfigLayersGetSizeBytes(layers, section, key, defaultValue, errNo) \
+	ConfigHandleGetSizeBytes(ConfigLayersLookupHandle(layers, section, key, NULL), defaultValue, errNo)
+#define ConfigLayersGetList(layers, section, key, count, errNo) \
+	ConfigHandleGetList(ConfigLayersLookupHandle(layers, section, key, NULL), count, errNo)
+
+#endif
@@ -1,408 +1,1722 @@
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "config_reader.h"
+#include "line_scanner.h"
+#include "config_value.h"
+#include "config_image.h"
 
 #define IS_SPACE_CHAR(c) ((c) == ' '||(c) == '\n'||(c) == '\t'||(c) == '\r')
-#define MAX_BUF_LEN 1024
+#define TEXT_BLOCK_SIZE (64 * 1024)
+#define CONFIG_STREAM_CHUNK (64 * 1024)
+#define SORT_INSERTION_LEN 16
+#define SORT_STACK_LEN 64
+#define PARALLEL_MIN_CHUNK (64 * 1024)	// 并行解析时每个线程至少处理的字节数
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_SORT_BATCH 64			// 并行排序时每次领取的section数
 
-typedef int(*CmpFunc)(const void *x, const void *y);
+static int parallelThreads = 0;
 
-static int ConfigSectionCmp(const void *x, const void *y)
+/*
+ * 文本块，所有section名、key和value的文本都保存在文本块中，
+ * 文本块写满后再分配新的文本块，已写入的文本地址不变
+ */
+typedef struct ConfigTextBlock
+{
+	struct ConfigTextBlock *next;
+	size_t size;
+	size_t used;
+	char data[1];
+}ConfigTextBlock;
+
+/*
+ * 解析过程中的状态，section和kv数组按需扩容
+ */
+typedef struct ConfigParser
+{
+	ConfigSection *sections;
+	int sectionCount;
+	int sectionCap;
+	ConfigKeyValue *kvs;
+	int kvCount;
+	int kvCap;
+	ConfigTextBlock *text;	// 当前写入的文本块，也是文本块链表的头
+	const char *srcEnd;		// 原始文本的结束地址
+	int inPlace;			// 是否直接在原始文本中写入'\0'，不复制文本
+	int allowOrphan;		// 并行解析时，块开头的kv属于前一个块的最后一个section
+	int orphan;				// sections[0]是否为收集这些kv的占位section
+}ConfigParser;
+
+static void ConfigTextDestory(ConfigTextBlock *text)
+{
+	while (text != NULL)
+	{
+		ConfigTextBlock *next = text->next;
+		free(text);
+		text = next;
+	}
+}
+
+static char* ConfigParserSaveText(ConfigParser *parser, const char *str, size_t len)
+{
+	if (parser->inPlace && str + len < parser->srcEnd)
+	{
+		// 原地写入结束符，str之后的字符已经解析过
+		char *dst = (char*)str;
+		dst[len] = '\0';
+		return dst;
+	}
+
+	ConfigTextBlock *text = parser->text;
+	if (text == NULL || text->size - text->used < len + 1)
+	{
+		size_t size = len + 1 > TEXT_BLOCK_SIZE || parser->inPlace ? len + 1 : TEXT_BLOCK_SIZE;
+		text = (ConfigTextBlock*)malloc(sizeof(ConfigTextBlock) + size);
+		if (text == NULL)
+		{
+			return NULL;
+		}
+		text->next = parser->text;
+		text->size = size;
+		text->used = 0;
+		parser->text = text;
+	}
+
+	char *dst = text->data + text->used;
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+	text->used += len + 1;
+	return dst;
+}
+
+static int ConfigParserAddSection(ConfigParser *parser, const char *name, size_t len)
+{
+	if (parser->sectionCount == parser->sectionCap)
+	{
+		int cap = parser->sectionCap > 0 ? parser->sectionCap * 2 : 16;
+		ConfigSection *sections = (ConfigSection*)realloc(parser->sections, sizeof(ConfigSection) * cap);
+		if (sections == NULL)
+		{
+			return ERR_MALLOC_FAILED;
+		}
+		parser->sections = sections;
+		parser->sectionCap = cap;
+	}
+
+	// name为NULL时是并行解析的占位section，合并时会被丢弃
+	ConfigSection *section = parser->sections + parser->sectionCount;
+	section->name = name != NULL ? ConfigParserSaveText(parser, name, len) : "";
+	if (section->name == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+	section->kvs = NULL;
+	section->kvCount = 0;
+	++parser->sectionCount;
+	return 0;
+}
+
+static int ConfigParserAddKeyValue(ConfigParser *parser, const char *key, size_t keyLen,
+	const char *value, size_t valueLen)
+{
+	if (parser->kvCount == parser->kvCap)
+	{
+		int cap = parser->kvCap > 0 ? parser->kvCap * 2 : 64;
+		ConfigKeyValue *kvs = (ConfigKeyValue*)realloc(parser->kvs, sizeof(ConfigKeyValue) * cap);
+		if (kvs == NULL)
+		{
+			return ERR_MALLOC_FAILED;
+		}
+		parser->kvs = kvs;
+		parser->kvCap = cap;
+	}
+
+	if (parser->sectionCount == 0)
+	{
+		int ret = ConfigParserAddSection(parser, NULL, 0);
+		if (ret != 0)
+		{
+			return ret;
+		}
+		parser->orphan = 1;
+	}
+
+	ConfigKeyValue *keyValue = parser->kvs + parser->kvCount;
+	keyValue->key = ConfigParserSaveText(parser, key, keyLen);
+	keyValue->value = ConfigParserSaveText(parser, value, valueLen);
+	keyValue->parsed = NULL;
+	if (keyValue->key == NULL || keyValue->value == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+	++parser->sections[parser->sectionCount - 1].kvCount;
+	++parser->kvCount;
+	return 0;
+}
+
+/*
+ * 去掉[*begin, *end)两端的空白字符
+ */
+static void TrimRange(const char **begin, const char **end)
+{
+	const char *b = *begin;
+	const char *e = *end;
+	while (b < e && IS_SPACE_CHAR(*b))
+	{
+		++b;
+	}
+	while (e > b && IS_SPACE_CHAR(e[-1]))
+	{
+		--e;
+	}
+	*begin = b;
+	*end = e;
+}
+
+/*
+ * 解析一行[begin, end)的内容，marks为扫描器找出的特殊字符位置
+ * 注释行和空行直接忽略
+ */
+static int ConfigParserParseLine(ConfigParser *parser, const char *begin, const char *end,
+	const LineMarks *marks)
+{
+	if (marks->comment != NULL)
+	{
+		// 删除注释
+		end = marks->comment;
+	}
+	TrimRange(&begin, &end);
+	// 注释行或空行，无需要进一步处理
+	if (begin == end)
+	{
+		return 0;
+	}
+
+	const char *equal = marks->equal;
+	const char *leftBracket = marks->leftBracket;
+	const char *rightBracket = marks->rightBracket;
+	if (leftBracket == begin && rightBracket != NULL && equal == NULL)
+	{
+		// [xxx]
+		const char *name = begin + 1;
+		TrimRange(&name, &rightBracket);
+		return ConfigParserAddSection(parser, name, rightBracket - name);
+	}
+	else if ((parser->sectionCount > 0 || parser->allowOrphan) && leftBracket == NULL && rightBracket == NULL && equal != NULL)
+	{
+		// xxx=yyy
+		const char *key = begin;
+		const char *keyEnd = equal;
+		const char *value = equal + 1;
+		const char *valueEnd = end;
+		TrimRange(&key, &keyEnd);
+		TrimRange(&value, &valueEnd);
+		return ConfigParserAddKeyValue(parser, key, keyEnd - key, value, valueEnd - value);
+	}
+	return ERR_CONFIG_FORMAT;
+}
+
+/*
+ * 逐行解析[buf, buf + len)，每一行只由扫描器读取一遍
+ */
+static int ConfigParserParse(ConfigParser *parser, const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	const char *line = buf;
+	LineMarks marks;
+	while (line < end)
+	{
+		const char *lineEnd = LineScannerScan(line, end, &marks);
+		int ret = ConfigParserParseLine(parser, line, lineEnd, &marks);
+		if (ret != 0)
+		{
+			return ret;
+		}
+		line = lineEnd + 1;
+	}
+	return 0;
+}
+
+static int ConfigParserInit(ConfigParser *parser, size_t textHint)
+{
+	memset(parser, 0, sizeof(ConfigParser));
+	if (textHint > 0)
+	{
+		// 预先分配足够大的文本块，解析结果不会超过原始文本的大小
+		parser->text = (ConfigTextBlock*)malloc(sizeof(ConfigTextBlock) + textHint);
+		if (parser->text == NULL)
+		{
+			return ERR_MALLOC_FAILED;
+		}
+		parser->text->next = NULL;
+		parser->text->size = textHint;
+		parser->text->used = 0;
+	}
+	return 0;
+}
+
+static void ConfigParserDestory(ConfigParser *parser)
+{
+	free(parser->sections);
+	free(parser->kvs);
+	ConfigTextDestory(parser->text);
+}
+
+/*
+ * 解析完成，把section、kv和文本的所有权交给reader
+ */
+static ConfigReader* ConfigParserFinish(ConfigParser *parser)
+{
+	ConfigReader *reader = (ConfigReader*)malloc(sizeof(ConfigReader));
+	if (reader == NULL)
+	{
+		return NULL;
+	}
+
+	// 每个section的kv在kvs数组中是连续的
+	ConfigKeyValue *kvs = parser->kvs;
+	int i = 0;
+	for (i = 0; i < parser->sectionCount; ++i)
+	{
+		parser->sections[i].kvs = kvs;
+		kvs += parser->sections[i].kvCount;
+	}
+
+	reader->sections = parser->sections;
+	reader->allKvs = parser->kvs;
+	reader->text = parser->text;
+	reader->source = NULL;
+	reader->sourceLen = 0;
+	reader->index = NULL;
+	reader->indexMask = 0;
+	reader->image = NULL;
+	reader->lazy = NULL;
+	reader->sectionCount = parser->sectionCount;
+	memset(parser, 0, sizeof(ConfigParser));
+	return reader;
+}
+
+/*
+ * 把普通文件映射到内存中，只读取一次
+ * writable非0时映射为可写的私有映射，修改不会写回文件
+ */
+static int ConfigFileMap(int fd, size_t len, int writable, char **buf)
+{
+	*buf = NULL;
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+	void *addr = mmap(NULL, len, prot, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED)
+	{
+		return ERR_OPEN_CONFIG;
+	}
+	madvise(addr, len, MADV_SEQUENTIAL);
+	*buf = (char*)addr;
+	return 0;
+}
+
+/*
+ * 把普通文件读入匿名私有映射，之后与文件无关，文件被原地改写或截短也不受影响
+ * 读到的字节数少于len时说明文件正在被改写，返回ERR_OPEN_CONFIG
+ */
+static int ConfigFileRead(int fd, size_t len, char **buf)
+{
+	*buf = NULL;
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+
+	size_t offset = 0;
+	while (offset < len)
+	{
+		ssize_t n = pread(fd, (char*)addr + offset, len - offset, offset);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			munmap(addr, len);
+			return ERR_OPEN_CONFIG;
+		}
+		offset += n;
+	}
+	*buf = (char*)addr;
+	return 0;
+}
+
+static void ConfigFileUnmap(char *buf, size_t len)
+{
+	if (buf != NULL)
+	{
+		munmap(buf, len);
+	}
+}
+
+/*
+ * 从readFunc流式读取并解析，每次只解析缓冲区中完整的行，
+ * 不完整的行移到缓冲区头部等待后续数据。
+ * 缓冲区平时为CONFIG_STREAM_CHUNK字节，遇到更长的行时临时扩大
+ */
+static int ConfigParserParseStream(ConfigParser *parser, ConfigReadFunc readFunc, void *ctx)
+{
+	size_t cap = CONFIG_STREAM_CHUNK;
+	size_t len = 0;
+	char *buf = (char*)malloc(cap);
+	if (buf == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+
+	int ret = 0;
+	while (1)
+	{
+		if (len == cap)
+		{
+			// 一行比缓冲区还长，扩大缓冲区
+			char *tmp = (char*)realloc(buf, cap * 2);
+			if (tmp == NULL)
+			{
+				ret = ERR_MALLOC_FAILED;
+				break;
+			}
+			buf = tmp;
+			cap *= 2;
+		}
+
+		long n = readFunc(ctx, buf + len, cap - len);
+		if (n < 0)
+		{
+			ret = ERR_READ_CONFIG;
+			break;
+		}
+		if (n == 0)
+		{
+			// 最后一行可能没有'\n'
+			ret = ConfigParserParse(parser, buf, len);
+			break;
+		}
+
+		// 只在新读入的数据中查找最后一个'\n'
+		const char *last = buf + len + n - 1;
+		while (last >= buf + len && *last != '\n')
+		{
+			--last;
+		}
+		int hasLine = last >= buf + len;
+		len += n;
+		if (!hasLine)
+		{
+			continue;
+		}
+
+		size_t done = last - buf + 1;
+		ret = ConfigParserParse(parser, buf, done);
+		if (ret != 0)
+		{
+			break;
+		}
+		len -= done;
+		memmove(buf, buf + done, len);
+
+		if (cap > CONFIG_STREAM_CHUNK && len < CONFIG_STREAM_CHUNK)
+		{
+			// 长行处理完后缩回原来的大小
+			char *tmp = (char*)realloc(buf, CONFIG_STREAM_CHUNK);
+			if (tmp != NULL)
+			{
+				buf = tmp;
+				cap = CONFIG_STREAM_CHUNK;
+			}
+		}
+	}
+
+	free(buf);
+	return ret;
+}
+
+static long ConfigFdRead(void *ctx, char *buf, size_t len)
+{
+	int fd = *(int*)ctx;
+	while (1)
+	{
+		ssize_t n = read(fd, buf, len);
+		if (n >= 0 || errno != EINTR)
+		{
+			return n;
+		}
+	}
+}
+
+/*
+ * 生成按字符串字段排序的函数，元素按类型直接赋值交换
+ * 非递归快速排序，三数取中选取枢纽，先处理较小的区间，栈深度不超过log(n)，
+ * 区间较小时改用插入排序
+ */
+#define DEFINE_STRING_SORT(FuncName, Type, field) \
+static void FuncName(Type *elems, int count) \
+{ \
+	int stack[SORT_STACK_LEN * 2]; \
+	int top = 0; \
+	int begin = 0; \
+	int end = count - 1; \
+	Type tmp; \
+	while (1) \
+	{ \
+		while (end - begin >= SORT_INSERTION_LEN) \
+		{ \
+			int mid = begin + (end - begin) / 2; \
+			if (strcmp(elems[mid].field, elems[begin].field) < 0) \
+			{ \
+				tmp = elems[mid]; elems[mid] = elems[begin]; elems[begin] = tmp; \
+			} \
+			if (strcmp(elems[end].field, elems[begin].field) < 0) \
+			{ \
+				tmp = elems[end]; elems[end] = elems[begin]; elems[begin] = tmp; \
+			} \
+			if (strcmp(elems[end].field, elems[mid].field) < 0) \
+			{ \
+				tmp = elems[end]; elems[end] = elems[mid]; elems[mid] = tmp; \
+			} \
+			const char *pivot = elems[mid].field; \
+			int i = begin; \
+			int j = end; \
+			while (i <= j) \
+			{ \
+				while (strcmp(elems[i].field, pivot) < 0) \
+					++i; \
+				while (strcmp(elems[j].field, pivot) > 0) \
+					--j; \
+				if (i <= j) \
+				{ \
+					tmp = elems[i]; elems[i] = elems[j]; elems[j] = tmp; \
+					++i; \
+					--j; \
+				} \
+			} \
+			if (j - begin < end - i) \
+			{ \
+				stack[top++] = i; \
+				stack[top++] = end; \
+				end = j; \
+			} \
+			else \
+			{ \
+				stack[top++] = begin; \
+				stack[top++] = j; \
+				begin = i; \
+			} \
+		} \
+		int i = 0; \
+		for (i = begin + 1; i <= end; ++i) \
+		{ \
+			tmp = elems[i]; \
+			int j = i - 1; \
+			while (j >= begin && strcmp(elems[j].field, tmp.field) > 0) \
+			{ \
+				elems[j + 1] = elems[j]; \
+				--j; \
+			} \
+			elems[j + 1] = tmp; \
+		} \
+		if (top == 0) \
+			break; \
+		end = stack[--top]; \
+		begin = stack[--top]; \
+	} \
+}
+
+DEFINE_STRING_SORT(SortSections, ConfigSection, name)
+DEFINE_STRING_SORT(SortKeyValues, ConfigKeyValue, key)
+
+typedef struct ConfigSortTask
+{
+	ConfigSection *sections;
+	int sectionCount;
+	int next;	// 下一个待领取的section，原子递增
+}ConfigSortTask;
+
+static void* ConfigSortWorker(void *arg)
+{
+	ConfigSortTask *task = (ConfigSortTask*)arg;
+	while (1)
+	{
+		int begin = __atomic_fetch_add(&task->next, PARALLEL_SORT_BATCH, __ATOMIC_RELAXED);
+		if (begin >= task->sectionCount)
+		{
+			break;
+		}
+
+		int end = begin + PARALLEL_SORT_BATCH;
+		end = end < task->sectionCount ? end : task->sectionCount;
+		int i = 0;
+		for (i = begin; i < end; ++i)
+		{
+			SortKeyValues(task->sections[i].kvs, task->sections[i].kvCount);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * 先排序每个section内的kv，threads大于1时多个线程按批领取section，
+ * 再排序section数组，移动section不影响其kvs指针
+ */
+static int ConfigReaderSort(ConfigReader *reader, int threads)
+{
+	ConfigSortTask task = {reader->sections, reader->sectionCount, 0};
+	pthread_t workers[PARALLEL_MAX_THREADS];
+	int started = 0;
+	for (started = 0; started < threads - 1; ++started)
+	{
+		if (pthread_create(workers + started, NULL, ConfigSortWorker, &task) != 0)
+		{
+			break;
+		}
+	}
+
+	// 当前线程也参与排序，创建线程失败时由当前线程完成剩余的工作
+	ConfigSortWorker(&task);
+	int i = 0;
+	for (i = 0; i < started; ++i)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	SortSections(reader->sections, reader->sectionCount);
+	return 0;
+}
+
+/*
+ * (section, key)的hash，section和key之间以'\0'分隔
+ */
+unsigned int ConfigIndexHash(const char *sectionName, const char *key)
+{
+	unsigned int hash = 2166136261U;
+	const unsigned char *pc = (const unsigned char*)sectionName;
+	while (*pc != '\0')
+	{
+		hash = (hash ^ *pc++) * 16777619U;
+	}
+	hash *= 16777619U;
+	pc = (const unsigned char*)key;
+	while (*pc != '\0')
+	{
+		hash = (hash ^ *pc++) * 16777619U;
+	}
+	return hash;
+}
+
+/*
+ * 为所有(section, key)建立开放寻址的hash索引，装载因子不超过0.5
+ * 同一个(section, key)出现多次时只索引排序后的第一个
+ */
+static int ConfigReaderBuildIndex(ConfigReader *reader)
+{
+	int kvCount = 0;
+	int i = 0;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		kvCount += reader->sections[i].kvCount;
+	}
+
+	unsigned int slotCnt = 16;
+	while (slotCnt < (unsigned int)kvCount * 2)
+	{
+		slotCnt *= 2;
+	}
+
+	ConfigIndexSlot *slots = (ConfigIndexSlot*)calloc(slotCnt, sizeof(ConfigIndexSlot));
+	if (slots == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+
+	unsigned int mask = slotCnt - 1;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		const ConfigSection *section = reader->sections + i;
+		int j = 0;
+		for (j = 0; j < section->kvCount; ++j)
+		{
+			const ConfigKeyValue *kv = section->kvs + j;
+			unsigned int hash = ConfigIndexHash(section->name, kv->key);
+			unsigned int k = hash & mask;
+			while (slots[k].kv != NULL)
+			{
+				if (slots[k].hash == hash && strcmp(slots[k].sectionName, section->name) == 0
+					&& strcmp(slots[k].kv->key, kv->key) == 0)
+				{
+					break;
+				}
+				k = (k + 1) & mask;
+			}
+
+			if (slots[k].kv == NULL)
+			{
+				slots[k].hash = hash;
+				slots[k].sectionName = section->name;
+				slots[k].kv = kv;
+			}
+		}
+	}
+
+	reader->index = slots;
+	reader->indexMask = mask;
+	return 0;
+}
+
+typedef struct ConfigParseTask
+{
+	ConfigParser parser;
+	const char *begin;
+	const char *end;
+	int ret;
+}ConfigParseTask;
+
+static void* ConfigParseWorker(void *arg)
+{
+	ConfigParseTask *task = (ConfigParseTask*)arg;
+	task->ret = ConfigParserParse(&task->parser, task->begin, task->end - task->begin);
+	return NULL;
+}
+
+/*
+ * 按顺序合并各块的解析结果，块开头的占位section的kv并入前面最后一个section。
+ * 各块的kv按顺序拼接后，前一个块最后一个section的kv正好与这些kv相邻
+ */
+static int ConfigParserMerge(ConfigParser *parser, ConfigParseTask *tasks, int count)
+{
+	int sectionCount = 0;
+	int kvCount = 0;
+	int i = 0;
+	for (i = 0; i < count; ++i)
+	{
+		sectionCount += tasks[i].parser.sectionCount - tasks[i].parser.orphan;
+		kvCount += tasks[i].parser.kvCount;
+	}
+
+	parser->sections = (ConfigSection*)malloc(sizeof(ConfigSection) * (sectionCount + 1));
+	parser->kvs = (ConfigKeyValue*)malloc(sizeof(ConfigKeyValue) * (kvCount + 1));
+	if (parser->sections == NULL || parser->kvs == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+	parser->sectionCap = sectionCount + 1;
+	parser->kvCap = kvCount + 1;
+
+	for (i = 0; i < count; ++i)
+	{
+		ConfigParser *part = &tasks[i].parser;
+		memcpy(parser->kvs + parser->kvCount, part->kvs, sizeof(ConfigKeyValue) * part->kvCount);
+		parser->kvCount += part->kvCount;
+
+		int j = 0;
+		for (j = 0; j < part->sectionCount; ++j)
+		{
+			if (j == 0 && part->orphan)
+			{
+				if (parser->sectionCount == 0)
+				{
+					// 第一个section之前出现kv
+					return ERR_CONFIG_FORMAT;
+				}
+				parser->sections[parser->sectionCount - 1].kvCount += part->sections[0].kvCount;
+			}
+			else
+			{
+				parser->sections[parser->sectionCount++] = part->sections[j];
+			}
+		}
+
+		// 把块的文本块链表接到parser的链表上
+		ConfigTextBlock *tail = part->text;
+		while (tail != NULL && tail->next != NULL)
+		{
+			tail = tail->next;
+		}
+		if (tail != NULL)
+		{
+			tail->next = parser->text;
+			parser->text = part->text;
+			part->text = NULL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * 在换行处把[buf, buf + len)切分为threads块，每个线程解析一块后再按顺序合并
+ */
+static int ConfigParserParseParallel(ConfigParser *parser, const char *buf, size_t len,
+	int zeroCopy, int threads)
+{
+	ConfigParseTask tasks[PARALLEL_MAX_THREADS];
+	pthread_t workers[PARALLEL_MAX_THREADS];
+	int started[PARALLEL_MAX_THREADS];
+	const char *end = buf + len;
+	const char *begin = buf;
+	int count = 0;
+	int ret = 0;
+
+	memset(parser, 0, sizeof(ConfigParser));
+	for (count = 0; count < threads && begin < end; ++count)
+	{
+		const char *chunkEnd = buf + len / threads * (count + 1);
+		if (count == threads - 1 || chunkEnd >= end)
+		{
+			chunkEnd = end;
+		}
+		else if (chunkEnd < begin)
+		{
+			chunkEnd = begin;
+		}
+
+		if (chunkEnd < end)
+		{
+			const char *lineEnd = (const char*)memchr(chunkEnd, '\n', end - chunkEnd);
+			chunkEnd = lineEnd != NULL ? lineEnd + 1 : end;
+		}
+
+		ConfigParseTask *task = tasks + count;
+		task->begin = begin;
+		task->end = chunkEnd;
+		task->ret = ConfigParserInit(&task->parser, zeroCopy ? 0 : chunkEnd - begin + 1);
+		task->parser.srcEnd = end;
+		task->parser.inPlace = zeroCopy;
+		task->parser.allowOrphan = count > 0;
+		begin = chunkEnd;
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// 第一块由当前线程解析，创建线程失败时也在当前线程解析
+	int i = 0;
+	for (i = 1; i < count; ++i)
+	{
+		started[i] = tasks[i].ret == 0
+			&& pthread_create(workers + i, NULL, ConfigParseWorker, tasks + i) == 0;
+	}
+	if (tasks[0].ret == 0)
+	{
+		ConfigParseWorker(tasks);
+	}
+	for (i = 1; i < count; ++i)
+	{
+		if (started[i])
+		{
+			pthread_join(workers[i], NULL);
+		}
+		else if (tasks[i].ret == 0)
+		{
+			ConfigParseWorker(tasks + i);
+		}
+	}
+
+	for (i = 0; i < count && ret == 0; ++i)
+	{
+		ret = tasks[i].ret;
+	}
+	if (ret == 0)
+	{
+		ret = ConfigParserMerge(parser, tasks, count);
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		ConfigParserDestory(&tasks[i].parser);
+	}
+	return ret;
+}
+
+/*
+ * 并行加载使用的线程数，文件较小时不值得创建线程
+ */
+static int ConfigParallelThreads(size_t len)
+{
+	int threads = __atomic_load_n(&parallelThreads, __ATOMIC_RELAXED);
+	if (threads <= 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (int)cpus : 1;
+	}
+
+	if ((size_t)threads > len / PARALLEL_MIN_CHUNK)
+	{
+		threads = (int)(len / PARALLEL_MIN_CHUNK);
+	}
+	if (threads > PARALLEL_MAX_THREADS)
+	{
+		threads = PARALLEL_MAX_THREADS;
+	}
+	return threads > 1 ? threads : 1;
+}
+
+void ConfigReaderSetParallelism(int threads)
+{
+	__atomic_store_n(&parallelThreads, threads, __ATOMIC_RELAXED);
+}
+
+/*
+ * 延迟解析时一个section在文件中的一段内容，同名section的多段内容串成链表
+ */
+typedef struct ConfigLazyRange
+{
+	size_t begin;
+	size_t end;
+	int section;	// 所属section的下标
+	int next;		// 同一section的下一段，-1表示结束
+}ConfigLazyRange;
+
+/*
+ * 一个section解析得到的kv和文本，增量加载时新旧reader共享内容未变的section
+ */
+typedef struct ConfigSectionStore
+{
+	int refCount;			// 原子读写
+	ConfigKeyValue *kvs;
+	int kvCount;
+	ConfigTextBlock *text;
+}ConfigSectionStore;
+
+typedef struct ConfigLazySection
+{
+	int firstRange;
+	int lastRange;
+	int loaded;					// 是否已经解析，原子读写
+	int err;					// 解析的错误码
+	ConfigSectionStore *store;	// 解析成功后有效
+	int hashed;
+	uint64_t hash;				// section内容的hash，比较时才计算
+}ConfigLazySection;
+
+/*
+ * 延迟解析的状态，初始只索引section名和各段内容的位置，
+ * section第一次被访问时才解析其中的kv并排序
+ */
+typedef struct ConfigLazy
+{
+	pthread_mutex_t lock;	// 串行化section的解析
+	const char *buf;
+	size_t len;
+	int inPlace;
+	ConfigLazySection *sections;	// 与reader->sections一一对应
+	ConfigLazyRange *ranges;
+	int *nameSlots;					// section名的hash索引，值为下标+1
+	unsigned int nameMask;
+}ConfigLazy;
+
+/*
+ * 在section名索引中查找name，返回name所在的槽或应插入的空槽
+ */
+static unsigned int ConfigLazyNameSlot(const ConfigLazy *lazy, const ConfigSection *sections,
+	const char *name)
+{
+	unsigned int i = ConfigIndexHash(name, "") & lazy->nameMask;
+	while (lazy->nameSlots[i] != 0 && strcmp(sections[lazy->nameSlots[i] - 1].name, name) != 0)
+	{
+		i = (i + 1) & lazy->nameMask;
+	}
+	return i;
+}
+
+/*
+ * 检查第一个section之前的内容，只能有注释和空行
+ */
+static int ConfigLazyCheckHead(const char *buf, size_t len)
+{
+	ConfigParser head;
+	int ret = ConfigParserInit(&head, 0);
+	if (ret == 0)
+	{
+		ret = ConfigParserParse(&head, buf, len);
+	}
+	ConfigParserDestory(&head);
+	return ret;
+}
+
+/*
+ * 解析section头所在的行，规则与ConfigParserParseLine相同
+ */
+static int ConfigLazyAddHeader(ConfigParser *parser, const char *begin, const char *end)
+{
+	LineMarks marks;
+	LineScannerScan(begin, end, &marks);
+	if (marks.comment != NULL)
+	{
+		end = marks.comment;
+	}
+	TrimRange(&begin, &end);
+	if (marks.leftBracket != begin || marks.rightBracket == NULL || marks.equal != NULL)
+	{
+		return ERR_CONFIG_FORMAT;
+	}
+
+	const char *name = begin + 1;
+	const char *nameEnd = marks.rightBracket;
+	TrimRange(&name, &nameEnd);
+	return ConfigParserAddSection(parser, name, nameEnd - name);
+}
+
+/*
+ * 只检查行首找出section头，记录每个section头之后到下一个section头之前的范围
+ */
+static int ConfigLazyScan(ConfigParser *parser, ConfigLazyRange **ranges, const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	const char *line = buf;
+	int rangeCap = 0;
+	int ret = 0;
+	while (line < end && ret == 0)
+	{
+		const char *lineEnd = (const char*)memchr(line, '\n', end - line);
+		lineEnd = lineEnd != NULL ? lineEnd : end;
+		const char *pc = line;
+		while (pc < lineEnd && IS_SPACE_CHAR(*pc))
+		{
+			++pc;
+		}
+
+		if (pc < lineEnd && *pc == '[')
+		{
+			if (parser->sectionCount == 0)
+			{
+				ret = ConfigLazyCheckHead(buf, line - buf);
+			}
+			if (ret == 0 && parser->sectionCount == rangeCap)
+			{
+				rangeCap = rangeCap > 0 ? rangeCap * 2 : 16;
+				ConfigLazyRange *tmp = (ConfigLazyRange*)realloc(*ranges, sizeof(ConfigLazyRange) * rangeCap);
+				if (tmp == NULL)
+				{
+					ret = ERR_MALLOC_FAILED;
+				}
+				*ranges = tmp != NULL ? tmp : *ranges;
+			}
+			if (ret == 0)
+			{
+				ret = ConfigLazyAddHeader(parser, line, lineEnd);
+			}
+			if (ret == 0)
+			{
+				int i = parser->sectionCount - 1;
+				if (i > 0)
+				{
+					(*ranges)[i - 1].end = line - buf;
+				}
+				(*ranges)[i].begin = lineEnd < end ? lineEnd - buf + 1 : len;
+				(*ranges)[i].end = len;
+				(*ranges)[i].section = i;
+				(*ranges)[i].next = -1;
+			}
+		}
+		line = lineEnd + 1;
+	}
+
+	if (ret == 0 && parser->sectionCount == 0)
+	{
+		ret = ConfigLazyCheckHead(buf, len);
+	}
+	return ret;
+}
+
+/*
+ * 合并同名section并排序，建立section名索引和每个section的范围链表
+ * rangeCount为合并前的section数，每个section头对应一个范围
+ */
+static int ConfigLazyBuild(ConfigLazy *lazy, ConfigParser *parser, int rangeCount)
+{
+	unsigned int slotCnt = 16;
+	while (slotCnt < (unsigned int)rangeCount * 2)
+	{
+		slotCnt *= 2;
+	}
+
+	lazy->nameSlots = (int*)calloc(slotCnt, sizeof(int));
+	lazy->sections = (ConfigLazySection*)calloc(rangeCount + 1, sizeof(ConfigLazySection));
+	int *order = (int*)malloc(sizeof(int) * (rangeCount + 1));
+	if (lazy->nameSlots == NULL || lazy->sections == NULL || order == NULL)
+	{
+		free(order);
+		return ERR_MALLOC_FAILED;
+	}
+	lazy->nameMask = slotCnt - 1;
+
+	// 同名的section只保留第一个
+	ConfigLazyRange *ranges = lazy->ranges;
+	int unique = 0;
+	int i = 0;
+	for (i = 0; i < rangeCount; ++i)
+	{
+		unsigned int k = ConfigLazyNameSlot(lazy, parser->sections, parser->sections[i].name);
+		if (lazy->nameSlots[k] == 0)
+		{
+			parser->sections[unique] = parser->sections[i];
+			lazy->nameSlots[k] = ++unique;
+		}
+		ranges[i].section = lazy->nameSlots[k] - 1;
+	}
+	parser->sectionCount = unique;
+
+	// 排序时借用kvCount记录排序前的下标
+	for (i = 0; i < unique; ++i)
+	{
+		parser->sections[i].kvCount = i;
+	}
+	SortSections(parser->sections, unique);
+
+	memset(lazy->nameSlots, 0, sizeof(int) * slotCnt);
+	for (i = 0; i < unique; ++i)
+	{
+		order[parser->sections[i].kvCount] = i;
+		parser->sections[i].kvCount = 0;
+		lazy->nameSlots[ConfigLazyNameSlot(lazy, parser->sections, parser->sections[i].name)] = i + 1;
+		lazy->sections[i].firstRange = -1;
+		lazy->sections[i].lastRange = -1;
+	}
+
+	for (i = 0; i < rangeCount; ++i)
+	{
+		ranges[i].section = order[ranges[i].section];
+		ConfigLazySection *section = lazy->sections + ranges[i].section;
+		if (section->lastRange < 0)
+		{
+			section->firstRange = i;
+		}
+		else
+		{
+			ranges[section->lastRange].next = i;
+		}
+		section->lastRange = i;
+	}
+	free(order);
+	return 0;
+}
+
+static void ConfigSectionStoreRelease(ConfigSectionStore *store)
+{
+	if (store == NULL || __atomic_sub_fetch(&store->refCount, 1, __ATOMIC_ACQ_REL) != 0)
+	{
+		return;
+	}
+
+	int i = 0;
+	for (i = 0; i < store->kvCount; ++i)
+	{
+		ConfigParsedValueDestory(store->kvs[i].parsed);
+	}
+	free(store->kvs);
+	ConfigTextDestory(store->text);
+	free(store);
+}
+
+static void ConfigLazyDestory(ConfigReader *reader)
+{
+	ConfigLazy *lazy = reader->lazy;
+	int i = 0;
+	for (i = 0; lazy->sections != NULL && i < reader->sectionCount; ++i)
+	{
+		ConfigSectionStoreRelease(lazy->sections[i].store);
+	}
+	pthread_mutex_destroy(&lazy->lock);
+	free(lazy->sections);
+	free(lazy->ranges);
+	free(lazy->nameSlots);
+	free(lazy);
+}
+
+/*
+ * section第一次被访问时解析其所有范围内的kv并排序，每个section只解析一次
+ */
+static int ConfigLazyLoad(const ConfigReader *reader, int index)
+{
+	ConfigLazy *lazy = reader->lazy;
+	ConfigLazySection *lazySection = lazy->sections + index;
+	if (__atomic_load_n(&lazySection->loaded, __ATOMIC_ACQUIRE))
+	{
+		return lazySection->err;
+	}
+
+	pthread_mutex_lock(&lazy->lock);
+	if (!lazySection->loaded)
+	{
+		size_t textHint = 0;
+		int r = 0;
+		for (r = lazySection->firstRange; r >= 0; r = lazy->ranges[r].next)
+		{
+			textHint += lazy->ranges[r].end - lazy->ranges[r].begin;
+		}
+
+		// 范围内没有section头，所有kv都归入占位section
+		ConfigParser parser;
+		int ret = ConfigParserInit(&parser, lazy->inPlace ? 0 : textHint + 1);
+		parser.srcEnd = lazy->buf + lazy->len;
+		parser.inPlace = lazy->inPlace;
+		parser.allowOrphan = 1;
+		for (r = lazySection->firstRange; r >= 0 && ret == 0; r = lazy->ranges[r].next)
+		{
+			const ConfigLazyRange *range = lazy->ranges + r;
+			ret = ConfigParserParse(&parser, lazy->buf + range->begin, range->end - range->begin);
+		}
+
+		ConfigSectionStore *store = NULL;
+		if (ret == 0)
+		{
+			store = (ConfigSectionStore*)malloc(sizeof(ConfigSectionStore));
+			ret = store != NULL ? 0 : ERR_MALLOC_FAILED;
+		}
+
+		if (ret == 0)
+		{
+			SortKeyValues(parser.kvs, parser.kvCount);
+			store->refCount = 1;
+			store->kvs = parser.kvs;
+			store->kvCount = parser.kvCount;
+			store->text = parser.text;
+			free(parser.sections);
+			lazySection->store = store;
+			reader->sections[index].kvs = store->kvs;
+			reader->sections[index].kvCount = store->kvCount;
+		}
+		else
+		{
+			ConfigParserDestory(&parser);
+		}
+		lazySection->err = ret;
+		__atomic_store_n(&lazySection->loaded, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&lazy->lock);
+	return lazySection->err;
+}
+
+static int ConfigLazyFindSection(const ConfigReader *reader, const char *sectionName)
 {
-	return strcmp(((ConfigSection*)x)->name, ((ConfigSection*)y)->name);
+	const ConfigLazy *lazy = reader->lazy;
+	return lazy->nameSlots[ConfigLazyNameSlot(lazy, reader->sections, sectionName)] - 1;
 }
 
-static int ConfigKeyValueCmp(const void *x, const void *y)
+static const ConfigKeyValue* ConfigLazyLookupHandle(const ConfigReader *reader,
+	const char *sectionName, const char *key)
 {
-	return strcmp(((ConfigKeyValue*)x)->key, ((ConfigKeyValue*)y)->key);
+	int i = ConfigLazyFindSection(reader, sectionName);
+	if (i < 0 || ConfigLazyLoad(reader, i) != 0)
+	{
+		return &ConfigKeyValueMissing;
+	}
+
+	const ConfigSection *section = reader->sections + i;
+	int begin = 0;
+	int end = section->kvCount - 1;
+	while (begin <= end)
+	{
+		int middle = begin + (end - begin) / 2;
+		int ret = strcmp(section->kvs[middle].key, key);
+		if (ret == 0)
+		{
+			return section->kvs + middle;
+		}
+		else if (ret < 0)
+		{
+			begin = middle + 1;
+		}
+		else
+		{
+			end = middle - 1;
+		}
+	}
+	return &ConfigKeyValueMissing;
 }
 
 /*
- * 删除字符串两端的空白字符
+ * 只索引section，section的kv在第一次访问时解析
+ * 返回的reader持有创建时读入的文件内容，零拷贝时持有文件映射
  */
-static void TrimString(char *str)
+static ConfigReader* ConfigReaderCreateLazy(char *buf, size_t len, int zeroCopy, int *errNo)
 {
-	char *pc = NULL;
-	for (pc = str + strlen(str) - 1; pc >= str && IS_SPACE_CHAR(*pc); --pc)
+	ConfigParser parser;
+	ConfigLazyRange *ranges = NULL;
+	int ret = ConfigParserInit(&parser, 0);
+	if (ret == 0)
+	{
+		ret = ConfigLazyScan(&parser, &ranges, buf, len);
+	}
+
+	ConfigLazy *lazy = NULL;
+	if (ret == 0)
+	{
+		lazy = (ConfigLazy*)calloc(1, sizeof(ConfigLazy));
+		ret = lazy != NULL ? 0 : ERR_MALLOC_FAILED;
+	}
+	if (ret == 0)
+	{
+		lazy->ranges = ranges;
+		ranges = NULL;
+		pthread_mutex_init(&lazy->lock, NULL);
+		ret = ConfigLazyBuild(lazy, &parser, parser.sectionCount);
+	}
+
+	ConfigReader *reader = NULL;
+	if (ret == 0)
 	{
-		*pc = '\0';
+		reader = ConfigParserFinish(&parser);
+		ret = reader != NULL ? 0 : ERR_MALLOC_FAILED;
 	}
 
-	for (pc = str; *pc != '\0' && IS_SPACE_CHAR(*pc); ++pc);
-	if (pc != str)
+	if (ret != 0)
 	{
-		char *dst = NULL;
-		for (dst = str; *pc; ++pc, ++dst)
+		if (errNo != NULL) *errNo = ret;
+		if (lazy != NULL)
 		{
-			*dst = *pc;
+			pthread_mutex_destroy(&lazy->lock);
+			free(lazy->sections);
+			free(lazy->ranges);
+			free(lazy->nameSlots);
+			free(lazy);
 		}
-		*dst = '\0';
+		free(ranges);
+		ConfigParserDestory(&parser);
+		ConfigFileUnmap(buf, len);
+		return NULL;
 	}
+
+	lazy->buf = buf;
+	lazy->len = len;
+	lazy->inPlace = zeroCopy;
+	reader->lazy = lazy;
+	reader->source = buf;
+	reader->sourceLen = len;
+	return reader;
 }
 
-/*
- * 对读取的文件行数据，进行预处理
- * @return 非0，需要进一步处理，0无需进一步处理
- */
-static int PreHandleInput(char *line)
+int ConfigReaderLoadSection(const ConfigReader *reader, const char *sectionName)
 {
-	TrimString(line);
-	// 注释行或空行，无需要进一步处理
-	if (line[0] == '\0' || line[0] == '#' || strncmp(line, "//", 2) == 0) 
+	if (reader == NULL || sectionName == NULL)
 	{
-		return 0;
+		return ERR_CONFIG_NULL;
 	}
 
-	// 行内注释，删除注释
-	char *comment = strstr(line, "//");
-	if (comment != NULL)
+	if (reader->lazy != NULL)
 	{
-		*comment = '\0';
-		TrimString(line);
+		int i = ConfigLazyFindSection(reader, sectionName);
+		return i >= 0 ? ConfigLazyLoad(reader, i) : ERR_KEY_NOT_FOUND;
 	}
 
-	comment = strchr(line, '#');
-	if (comment != NULL)
+	if (reader->image != NULL)
 	{
-		*comment = '\0';
-		TrimString(line);
+		// 镜像reader没有sections，section表在映射的镜像中
+		return ConfigImageFindSection(reader, sectionName) >= 0 ? 0 : ERR_KEY_NOT_FOUND;
 	}
 
-	return 1;
+	int i = 0;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		if (strcmp(reader->sections[i].name, sectionName) == 0)
+		{
+			return 0;
+		}
+	}
+	return ERR_KEY_NOT_FOUND;
 }
 
 /*
- * 分析配置文件conf的内容,计算文件中的总section数,kv数和有效的总字节数
+ * 按8字节一组计算内容hash，只用于比较section内容是否变化
  */
-static int AnalyseConfig(const char *conf, int *sectionCount, int *kvCount, int *bytes)
+static uint64_t ConfigHashBytes(uint64_t hash, const char *data, size_t len)
 {
-	FILE *fconf = fopen(conf, "r");
-	if (fconf == NULL)
+	size_t i = 0;
+	for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
 	{
-		return ERR_OPEN_CONFIG;
+		uint64_t word = 0;
+		memcpy(&word, data + i, sizeof(uint64_t));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+	for (; i < len; ++i)
+	{
+		hash = (hash ^ (unsigned char)data[i]) * 0x100000001B3ULL;
 	}
+	return hash ^ len;
+}
 
-	*sectionCount = 0;
-	*kvCount = 0;
-	*bytes = 0;
-	char buffer[MAX_BUF_LEN] = {0};
-	while (fgets(buffer, sizeof(buffer) - 1, fconf))
+/*
+ * hash在比较时才计算，内容来自创建时读入的私有副本，文件之后被原地改写也不影响
+ */
+static uint64_t ConfigLazyHash(const ConfigReader *reader, int index)
+{
+	ConfigLazy *lazy = reader->lazy;
+	ConfigLazySection *lazySection = lazy->sections + index;
+	pthread_mutex_lock(&lazy->lock);
+	if (!lazySection->hashed)
 	{
-		if (PreHandleInput(buffer) == 0) 
+		uint64_t hash = 14695981039346656037ULL;
+		int r = 0;
+		for (r = lazySection->firstRange; r >= 0; r = lazy->ranges[r].next)
 		{
-			continue;
+			const ConfigLazyRange *range = lazy->ranges + r;
+			hash = ConfigHashBytes(hash, lazy->buf + range->begin, range->end - range->begin);
 		}
+		lazySection->hash = hash;
+		lazySection->hashed = 1;
+	}
+	pthread_mutex_unlock(&lazy->lock);
+	return lazySection->hash;
+}
+
+/*
+ * 新reader的section内容与旧reader相同时直接共享已解析的存储，
+ * 旧section未解析时新section同样延迟解析
+ */
+static void ConfigLazyShare(const ConfigReader *old, int oldIndex, ConfigReader *reader, int index)
+{
+	ConfigLazySection *from = old->lazy->sections + oldIndex;
+	pthread_mutex_lock(&old->lazy->lock);
+	ConfigSectionStore *store = from->loaded ? from->store : NULL;
+	if (store != NULL)
+	{
+		__atomic_add_fetch(&store->refCount, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&old->lazy->lock);
 
-		char *equal = strchr(buffer, '=');
-		char *leftBracket = strchr(buffer, '[');
-		char *rightBracket = strchr(buffer, ']');
-		if (leftBracket == buffer && rightBracket != NULL && equal == NULL)
+	if (store != NULL)
+	{
+		// 新reader还未返回给调用方，不需要加锁
+		ConfigLazySection *to = reader->lazy->sections + index;
+		to->store = store;
+		to->err = 0;
+		reader->sections[index].kvs = store->kvs;
+		reader->sections[index].kvCount = store->kvCount;
+		__atomic_store_n(&to->loaded, 1, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * 比较同名section的kv，两边都已按key排序，section不存在时传NULL
+ */
+static void ConfigDiffSection(const char *sectionName, const ConfigSection *oldSection,
+	const ConfigSection *newSection, ConfigChangeFunc func, void *ctx)
+{
+	int oldCount = oldSection != NULL ? oldSection->kvCount : 0;
+	int newCount = newSection != NULL ? newSection->kvCount : 0;
+	int i = 0;
+	int j = 0;
+	while (i < oldCount || j < newCount)
+	{
+		int cmp = i >= oldCount ? 1 : (j >= newCount ? -1
+			: strcmp(oldSection->kvs[i].key, newSection->kvs[j].key));
+		if (cmp < 0)
 		{
-			++(*sectionCount);
-			// [xxx] => xxx\0
-			*bytes += (strlen(buffer) - 1);
+			func(ctx, CONFIG_CHANGE_REMOVED, sectionName, oldSection->kvs[i].key,
+				oldSection->kvs[i].value, NULL);
+			++i;
 		}
-		else if (sectionCount > 0 && leftBracket == NULL && rightBracket == NULL && equal != NULL)
+		else if (cmp > 0)
 		{
-			++(*kvCount);
-			// xxx=yyy => xxx\0yyy\0
-			*bytes += (strlen(buffer) + 1);
+			func(ctx, CONFIG_CHANGE_ADDED, sectionName, newSection->kvs[j].key,
+				NULL, newSection->kvs[j].value);
+			++j;
 		}
 		else
 		{
-			fclose(fconf);
-			return ERR_CONFIG_FORMAT;
+			if (strcmp(oldSection->kvs[i].value, newSection->kvs[j].value) != 0)
+			{
+				func(ctx, CONFIG_CHANGE_MODIFIED, sectionName, newSection->kvs[j].key,
+					oldSection->kvs[i].value, newSection->kvs[j].value);
+			}
+			++i;
+			++j;
 		}
 	}
-
-	fclose(fconf);
-	return 0;
 }
 
-static ConfigReader* ConfigReaderCreateObj(int sectionCount, int kvCount, int bytes)
+/*
+ * 按section名归并新旧reader，内容相同的section共享存储，
+ * 其余的记录到pairs中，每对为旧下标和新下标，不存在时为-1
+ * @return pairs中的对数
+ */
+static int ConfigDiffMatch(const ConfigReader *old, ConfigReader *reader, int *pairs)
 {
-	ConfigReader *reader = (ConfigReader*)malloc(sizeof(ConfigReader));
-	if (reader == NULL)
+	int count = 0;
+	int i = 0;
+	int j = 0;
+	while (i < old->sectionCount || j < reader->sectionCount)
 	{
-		return NULL;
+		int cmp = i >= old->sectionCount ? 1 : (j >= reader->sectionCount ? -1
+			: strcmp(old->sections[i].name, reader->sections[j].name));
+		if (cmp == 0 && ConfigLazyHash(old, i) == ConfigLazyHash(reader, j))
+		{
+			ConfigLazyShare(old, i, reader, j);
+			++i;
+			++j;
+			continue;
+		}
+
+		pairs[count * 2] = cmp <= 0 ? i++ : -1;
+		pairs[count * 2 + 1] = cmp >= 0 ? j++ : -1;
+		++count;
 	}
+	return count;
+}
 
-	ConfigSection *sections = (ConfigSection*)malloc(sizeof(ConfigSection) * sectionCount);
-	if (sections == NULL)
+ConfigReader* ConfigReaderCreateDiff(const char *fileName, int flags, const ConfigReader *old,
+	ConfigChangeFunc func, void *ctx, int *errNo)
+{
+	// 零拷贝的kv指向文件映射，不能在reader之间共享
+	if (old != NULL && (old->lazy == NULL || old->lazy->inPlace))
 	{
-		free(reader);
+		if (errNo != NULL) *errNo = ERR_VALUE_INVALID;
 		return NULL;
 	}
 
-	ConfigKeyValue *kvs = (ConfigKeyValue*)malloc(sizeof(ConfigKeyValue) * kvCount);
-	if (kvs == NULL)
+	flags = (flags | CONFIG_READER_LAZY) & ~(CONFIG_READER_ZERO_COPY | CONFIG_READER_PARALLEL);
+	ConfigReader *reader = ConfigReaderCreateEx(fileName, flags, errNo);
+	if (reader == NULL || old == NULL)
 	{
-		free(sections);
-		free(reader);
-		return NULL;
+		return reader;
 	}
 
-	char *text = (char*)malloc(bytes);
-	if (text == NULL)
+	// 不是普通文件时没有按延迟模式加载
+	if (reader->lazy == NULL)
 	{
-		free(kvs);
-		free(sections);
-		free(reader);
+		ConfigReaderDestory(reader);
+		if (errNo != NULL) *errNo = ERR_VALUE_INVALID;
 		return NULL;
 	}
 
-	reader->sections = sections;
-	reader->allKvs = kvs;
-	reader->text = text;
-	reader->sectionCount = sectionCount;
-	return reader;
-}
-
-static int ConfigReaderLoadConfig(ConfigReader *reader, const char *conf)
-{
-	FILE *fconf = fopen(conf, "r");
-	if (fconf == NULL)
+	int *pairs = (int*)malloc(sizeof(int) * 2 * (old->sectionCount + reader->sectionCount + 1));
+	if (pairs == NULL)
 	{
-		return ERR_OPEN_CONFIG;
+		ConfigReaderDestory(reader);
+		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		return NULL;
 	}
 
-	ConfigSection *section = reader->sections;
-	ConfigKeyValue *keyValue = reader->allKvs;
-	char *text = reader->text;
-
-	char buffer[MAX_BUF_LEN] = {0};
-	char *pc = '\0';
-	unsigned len = 0;
-	int isFirstSection = 1;
+	// 先解析所有变化的section，有格式错误时不通知任何变化
+	int count = ConfigDiffMatch(old, reader, pairs);
+	int ret = 0;
 	int i = 0;
-	while (fgets(buffer, sizeof(buffer)-1, fconf))
+	for (i = 0; i < count && ret == 0; ++i)
 	{
-		if (PreHandleInput(buffer) == 0)
+		if (pairs[i * 2 + 1] >= 0)
 		{
-			continue;
+			ret = ConfigLazyLoad(reader, pairs[i * 2 + 1]);
 		}
-
-		if (buffer[0] == '[')
+		if (pairs[i * 2] >= 0)
 		{
-			pc = strchr(buffer + 1, ']');
-			if (pc == NULL)
-			{
-				continue;
-			}
-
-			if (!isFirstSection)
-			{
-				++section;
-			}
-			section->kvs = keyValue;
-			section->kvCount = 0;
-
-			*pc = '\0';
-			TrimString(buffer+1);
-			len = strlen(buffer+1);
-			memcpy(text, buffer + 1, len + 1);
-			section->name = text;
-			text += (len + 1);
-			isFirstSection = 0;
+			// 旧配置中从未访问的section可能有格式错误，按空section比较
+			ConfigLazyLoad(old, pairs[i * 2]);
 		}
-		else
-		{
-			pc = strchr(buffer, '=');
-			if (pc == NULL)
-			{
-				continue;
-			}
+	}
+
+	if (ret != 0)
+	{
+		free(pairs);
+		ConfigReaderDestory(reader);
+		if (errNo != NULL) *errNo = ret;
+		return NULL;
+	}
 
-			*pc = '\0';
-			char *strKey = buffer;
-			char *strValue = pc + 1;
-			TrimString(strKey);
-			TrimString(strValue);
+	for (i = 0; i < count && func != NULL; ++i)
+	{
+		const ConfigSection *oldSection = pairs[i * 2] >= 0 ? old->sections + pairs[i * 2] : NULL;
+		const ConfigSection *newSection = pairs[i * 2 + 1] >= 0 ? reader->sections + pairs[i * 2 + 1] : NULL;
+		ConfigDiffSection(oldSection != NULL ? oldSection->name : newSection->name,
+			oldSection, newSection, func, ctx);
+	}
+	free(pairs);
+	return reader;
+}
 
-			len = strlen(strKey);
-			memcpy(text, strKey, len + 1);
-			keyValue->key = text;
-			text += (len + 1);
+/*
+ * 解析完成后生成reader，排序并建立索引，失败时释放parser
+ */
+static ConfigReader* ConfigParserBuild(ConfigParser *parser, int threads, int *errNo)
+{
+	ConfigReader *reader = ConfigParserFinish(parser);
+	if (reader == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		ConfigParserDestory(parser);
+		return NULL;
+	}
 
-			len = strlen(strValue);
-			memcpy(text, strValue, len + 1);
-			keyValue->value = text;
-			text += (len + 1);
+	int ret = ConfigReaderSort(reader, threads);
+	if (ret == 0)
+	{
+		ret = ConfigReaderBuildIndex(reader);
+	}
 
-			++section->kvCount;
-			++i;
-			++keyValue;
-		}
+	if (ret != 0)
+	{
+		if (errNo != NULL) *errNo = ret;
+		ConfigReaderDestory(reader);
+		return NULL;
 	}
-	fclose(fconf);
-	return 0;
+	return reader;
 }
 
-static void ElemSwap(void *x, void *y, unsigned int size, void *swapBuf)
+ConfigReader* ConfigReaderCreate(const char *fileName, int *errNo)
 {
-	memcpy(swapBuf, x, size);
-	memcpy(x, y, size);
-	memcpy(y, swapBuf, size);
+	return ConfigReaderCreateEx(fileName, 0, errNo);
 }
 
-static void QuickSort(void *elems, int begin, int end, unsigned int elemSize, 
-	CmpFunc compare, void *swapBuf)
+ConfigReader* ConfigReaderCreateEx(const char *fileName, int flags, int *errNo)
 {
-	if (elems == NULL || begin >= end)
+	int ret = 0;
+	if (fileName == NULL)
 	{
-		return;
+		if (errNo != NULL) *errNo = ERR_CONFIG_NULL;
+		return NULL;
 	}
 
-	//随机选取一个元素作为枢纽，并与最后一个元素交换
-	char *celems = (char*)elems;
-	int ic = rand()%(end - begin + 1) + begin;
-	ElemSwap(celems + ic * elemSize, celems + end * elemSize, elemSize, swapBuf);
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		if (errNo != NULL) *errNo = ERR_OPEN_CONFIG;
+		return NULL;
+	}
 
-	void *centre = (void*)(celems + end * elemSize);
-	int i = begin;
-	int j = end - 1;
-	while(1)
+	struct stat st;
+	if (fstat(fd, &st) != 0)
 	{
-		//从前向后扫描，找到第一个小于枢纽的值，
-		//在到达数组末尾前，必定结束循环,因为最后一个值为centre
-		while (compare(celems + i * elemSize, centre) < 0)
-			++i;
-		//从后向前扫描，此时要检查下标，防止数组越界
-		while(j >= begin && compare(celems + j * elemSize, centre) > 0)
-			--j;
-		//如果没有完成一趟交换，则交换
-		if(i < j)
-			ElemSwap(celems + elemSize * i++, celems + elemSize * j--, elemSize, swapBuf);
-		else
-			break;
+		if (errNo != NULL) *errNo = ERR_OPEN_CONFIG;
+		close(fd);
+		return NULL;
 	}
-	//把枢纽放在正确的位置
-	ElemSwap(celems + i * elemSize, celems + end * elemSize, elemSize, swapBuf);
-	QuickSort(elems, begin, i - 1, elemSize, compare, swapBuf);
-	QuickSort(elems, i + 1, end, elemSize, compare, swapBuf);
-}
 
-static int Sort(void *elems, int count, unsigned int elemSize, CmpFunc compare)
-{
-	if (elemSize <= MAX_BUF_LEN)
+	if (!S_ISREG(st.st_mode))
 	{
-		char swapBuf[MAX_BUF_LEN] = {0};
-		QuickSort(elems, 0, count - 1, elemSize, compare, swapBuf);
+		// 管道、设备等无法映射，流式读取，此时不支持零拷贝
+		ConfigReader *reader = ConfigReaderCreateFromFd(fd, errNo);
+		close(fd);
+		return reader;
+	}
+
+	int zeroCopy = (flags & CONFIG_READER_ZERO_COPY) != 0;
+	char *buf = NULL;
+	size_t len = st.st_size;
+	if ((flags & CONFIG_READER_LAZY) && !zeroCopy)
+	{
+		// 延迟解析的section在之后才读取内容，不能依赖仍可能被原地改写的文件映射
+		ret = ConfigFileRead(fd, len, &buf);
 	}
 	else
 	{
-		void *swapBuf = malloc(elemSize);
-		if (swapBuf == NULL)
-		{
-			return ERR_MALLOC_FAILED;
-		}
-
-		QuickSort(elems, 0, count - 1, elemSize, compare, swapBuf);
-		free(swapBuf);
+		ret = ConfigFileMap(fd, len, zeroCopy, &buf);
 	}
-	return 0;
-}
-
-static int ConfigReaderSort(ConfigReader *reader)
-{
-	srand(time(NULL));
-
-	int ret = Sort(reader->sections, reader->sectionCount, sizeof(ConfigSection), ConfigSectionCmp);
+	close(fd);
 	if (ret != 0)
 	{
-		return ret;
+		if (errNo != NULL) *errNo = ret;
+		return NULL;
 	}
 
-	int i = 0;
-	ConfigSection *section = reader->sections;
-	for (i = 0; i < reader->sectionCount; ++i)
+	if (flags & CONFIG_READER_LAZY)
 	{
-		ret = Sort(section->kvs, section->kvCount, sizeof(ConfigKeyValue), ConfigKeyValueCmp);
-		if (ret != 0)
-		{
-			return ret;
-		}
-		++section;
+		return ConfigReaderCreateLazy(buf, len, zeroCopy, errNo);
 	}
-	return 0;
-}
 
-static int BinSearch(const void *elems, int count, unsigned int elemSize, 
-	const void *key, CmpFunc compare)
-{
-	int begin = 0;
-	int end = count - 1;
-	const char *celems = (const char*)elems;
-	while (begin <= end)
+	// 只扫描一遍文件，边解析边保存section和kv
+	int threads = (flags & CONFIG_READER_PARALLEL) ? ConfigParallelThreads(len) : 1;
+	ConfigParser parser;
+	if (threads > 1)
 	{
-		int middle = begin + (end - begin) / 2;
-		int ret = compare(celems + elemSize * middle, key);
+		ret = ConfigParserParseParallel(&parser, buf, len, zeroCopy, threads);
+	}
+	else
+	{
+		ret = ConfigParserInit(&parser, zeroCopy ? 0 : len + 1);
 		if (ret == 0)
 		{
-			return middle;
-		}
-		else if (ret < 0)
-		{
-			begin = middle + 1;
+			parser.srcEnd = buf + len;
+			parser.inPlace = zeroCopy;
+			ret = ConfigParserParse(&parser, buf, len);
 		}
-		else
+	}
+
+	if (ret != 0)
+	{
+		if (errNo != NULL) *errNo = ret;
+		ConfigParserDestory(&parser);
+		ConfigFileUnmap(buf, len);
+		return NULL;
+	}
+
+	ConfigReader *reader = NULL;
+	if (zeroCopy)
+	{
+		reader = ConfigParserBuild(&parser, threads, errNo);
+		if (reader == NULL)
 		{
-			end = middle - 1;
+			ConfigFileUnmap(buf, len);
+			return NULL;
 		}
-
+		// key和value指向文件映射，由reader负责释放
+		reader->source = buf;
+		reader->sourceLen = len;
+	}
+	else
+	{
+		ConfigFileUnmap(buf, len);
+		reader = ConfigParserBuild(&parser, threads, errNo);
 	}
-	return -1;
+	return reader;
 }
 
-ConfigReader* ConfigReaderCreate(const char *fileName, int *errNo)
+ConfigReader* ConfigReaderCreateFromFd(int fd, int *errNo)
 {
-	int ret = 0;
-	if (fileName == NULL)
+	if (fd < 0)
 	{
 		if (errNo != NULL) *errNo = ERR_CONFIG_NULL;
 		return NULL;
 	}
+	return ConfigReaderCreateFromCallback(ConfigFdRead, &fd, errNo);
+}
 
-	int sectionCount = 0;
-	int kvCount = 0;
-	int bytes = 0;
-	ret = AnalyseConfig(fileName, &sectionCount, &kvCount, &bytes);
-	if (ret != 0)
-	{
-		if (errNo != NULL) *errNo = ret;
-		return NULL;
-	}
-
-	ConfigReader *reader = ConfigReaderCreateObj(sectionCount, kvCount, bytes);
-	if (reader == NULL)
+ConfigReader* ConfigReaderCreateFromCallback(ConfigReadFunc readFunc, void *ctx, int *errNo)
+{
+	if (readFunc == NULL)
 	{
-		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		if (errNo != NULL) *errNo = ERR_CONFIG_NULL;
 		return NULL;
 	}
 
-	ret = ConfigReaderLoadConfig(reader, fileName);
-	if (ret != 0)
+	ConfigParser parser;
+	int ret = ConfigParserInit(&parser, 0);
+	if (ret == 0)
 	{
-		if (errNo != NULL) *errNo = ret;
-		ConfigReaderDestory(reader);
-		return NULL;
+		ret = ConfigParserParseStream(&parser, readFunc, ctx);
 	}
 
-	ret = ConfigReaderSort(reader);
 	if (ret != 0)
 	{
 		if (errNo != NULL) *errNo = ret;
-		ConfigReaderDestory(reader);
+		ConfigParserDestory(&parser);
 		return NULL;
 	}
-
-	return reader;
+	return ConfigParserBuild(&parser, 1, errNo);
 }
 
-
 void ConfigReaderDestory(ConfigReader *reader)
 {
 	if (reader == NULL)
@@ -410,6 +1724,32 @@ void ConfigReaderDestory(ConfigReader *reader)
 		return;
 	}
 
+	int i = 0;
+	if (reader->image != NULL)
+	{
+		// 镜像reader的kv是第一次查找handle时填写的，没有查找过handle时kv表为NULL
+		for (i = 0; reader->allKvs != NULL && i < (int)reader->image->kvCount; ++i)
+		{
+			ConfigParsedValueDestory(reader->allKvs[i].parsed);
+		}
+	}
+	else if (reader->lazy != NULL)
+	{
+		// kv和解析缓存属于section的存储，可能与其他reader共享
+		ConfigLazyDestory(reader);
+	}
+	else
+	{
+		for (i = 0; i < reader->sectionCount; ++i)
+		{
+			int j = 0;
+			for (j = 0; j < reader->sections[i].kvCount; ++j)
+			{
+				ConfigParsedValueDestory(reader->sections[i].kvs[j].parsed);
+			}
+		}
+	}
+
 	if (reader->sections != NULL)
 	{
 		free(reader->sections);
@@ -420,36 +1760,65 @@ void ConfigReaderDestory(ConfigReader *reader)
 		free(reader->allKvs);
 	}
 
-	if (reader->text != NULL)
+	free(reader->index);
+	ConfigTextDestory(reader->text);
+	if (reader->source != NULL)
 	{
-		free(reader->text);
+		ConfigFileUnmap(reader->source, reader->sourceLen);
 	}
-
 	free(reader);
 }
 
-const char* ConfigReaderGetValue(const ConfigReader *reader,
+const ConfigKeyValue ConfigKeyValueMissing = {"", "", NULL};
+
+const ConfigKeyValue* ConfigReaderLookupHandle(const ConfigReader *reader,
 	const char *sectionName, const char *key)
 {
 	if (reader == NULL || sectionName == NULL || key == NULL)
 	{
-		return "";
+		return &ConfigKeyValueMissing;
+	}
+
+	if (reader->image != NULL)
+	{
+		return ConfigImageLookupHandle(reader, sectionName, key);
+	}
+
+	if (reader->lazy != NULL)
+	{
+		return ConfigLazyLookupHandle(reader, sectionName, key);
+	}
+
+	if (reader->index == NULL)
+	{
+		return &ConfigKeyValueMissing;
 	}
 
-	ConfigSection section = {sectionName, NULL, 0};
-	ConfigKeyValue keyValue = {key, NULL};
-	int i = BinSearch(reader->sections, reader->sectionCount, sizeof(ConfigSection), 
-		&section, ConfigSectionCmp);
-	if (i >= 0)
+	unsigned int hash = ConfigIndexHash(sectionName, key);
+	unsigned int i = hash & reader->indexMask;
+	const ConfigIndexSlot *slot = reader->index + i;
+	while (slot->kv != NULL)
 	{
-		int j = BinSearch(reader->sections[i].kvs, reader->sections[i].kvCount, sizeof(ConfigKeyValue),
-			&keyValue, ConfigKeyValueCmp);
-		if (j >= 0)
+		if (slot->hash == hash && strcmp(slot->kv->key, key) == 0
+			&& strcmp(slot->sectionName, sectionName) == 0)
 		{
-			return reader->sections[i].kvs[j].value;
+			return slot->kv;
 		}
+		i = (i + 1) & reader->indexMask;
+		slot = reader->index + i;
 	}
-	return "";
+	return &ConfigKeyValueMissing;
+}
+
+const char* ConfigReaderGetValue(const ConfigReader *reader,
+	const char *sectionName, const char *key)
+{
+	if (reader != NULL && reader->image != NULL && sectionName != NULL && key != NULL)
+	{
+		// 镜像直接返回字符串池中的value，不需要填写kv
+		return ConfigImageGetValue(reader, sectionName, key);
+	}
+	return ConfigReaderLookupHandle(reader, sectionName, key)->value;
 }
 
 void ConfigReaderPrint(const ConfigReader *reader)
@@ -459,7 +1828,22 @@ void ConfigReaderPrint(const ConfigReader *reader)
 		return;
 	}
 
+	if (reader->image != NULL)
+	{
+		ConfigImagePrint(reader);
+		return;
+	}
+
 	int i = 0;
+	if (reader->lazy != NULL)
+	{
+		// 打印前解析所有section
+		for (i = 0; i < reader->sectionCount; ++i)
+		{
+			ConfigLazyLoad(reader, i);
+		}
+	}
+
 	int j = 0;
 	ConfigSection *section = NULL;
 	ConfigKeyValue *keyValue = NULL;
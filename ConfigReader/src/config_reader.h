@@ -1,16 +1,43 @@
 #ifndef _CONFIG_READER_H
 #define _CONFIG_READER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define ERR_CONFIG_NULL -1001
 #define ERR_OPEN_CONFIG -1002
 #define ERR_CONFIG_FORMAT -1003
+#define ERR_READ_CONFIG -1004
+#define ERR_KEY_NOT_FOUND -1005
+#define ERR_VALUE_INVALID -1006
+#define ERR_IMAGE_FORMAT -1009
+#define ERR_IMAGE_CHECKSUM -1010
+#define ERR_WRITE_IMAGE -1011
 
 #define ERR_MALLOC_FAILED -2001
 
+// ConfigReaderCreateEx的flags
+#define CONFIG_READER_ZERO_COPY 0x1	// key和value直接指向文件的私有可写映射，不复制文本；
+									// 未写入的页仍由文件提供，文件在reader销毁前不能被原地改写或截短
+#define CONFIG_READER_PARALLEL 0x4	// 多线程切块解析和排序，适合很大的配置文件
+#define CONFIG_READER_LAZY 0x8		// 只索引section，section的kv在第一次访问时才解析，
+									// 文件内容在创建时读入，之后文件被改写不影响reader
+// ConfigReaderOpenImage的flags
+#define CONFIG_READER_VERIFY_IMAGE 0x2	// 打开时校验整个镜像的checksum
+
+/*
+ * 流式读取配置的回调，与read(2)的语义相同
+ * @return 读到的字节数，0表示读取结束，负数表示出错
+ */
+typedef long(*ConfigReadFunc)(void *ctx, char *buf, size_t len);
+
+typedef struct ConfigParsedValue ConfigParsedValue;
+
 typedef struct ConfigKeyValue
 {
 	const char* key;	// key的文本的地址
 	const char* value;	// value的文本的地址
+	ConfigParsedValue *parsed;	// 类型化读取的缓存，第一次读取时生成
 }ConfigKeyValue;
 
 typedef struct ConfigSection
@@ -20,11 +47,27 @@ typedef struct ConfigSection
 	int kvCount;			// kv的数量, ConfigKeyValue的元素个数
 }ConfigSection;
 
+/*
+ * (section, key)索引的槽，kv为NULL表示空槽
+ */
+typedef struct ConfigIndexSlot
+{
+	unsigned int hash;
+	const char *sectionName;
+	const ConfigKeyValue *kv;
+}ConfigIndexSlot;
+
 typedef struct ConfigReader
 {
 	ConfigSection *sections;	// section的起始地址
 	ConfigKeyValue *allKvs;  	// 所有kvs的起始地址
-	char *text;             	// 所有文本的起始地址
+	struct ConfigTextBlock *text;	// 所有文本所在的文本块链表
+	char *source;				// 零拷贝模式下key和value所在的文件映射，否则为NULL
+	size_t sourceLen;
+	ConfigIndexSlot *index;		// 加载时建立的(section, key)索引
+	unsigned int indexMask;		// 索引的槽数-1
+	const struct ConfigImageHeader *image;	// 由二进制镜像打开时指向映射的镜像，否则为NULL
+	struct ConfigLazy *lazy;	// 延迟解析的状态，非延迟模式为NULL
 	int sectionCount;       	// section的个数
 }ConfigReader;
 
@@ -34,11 +77,115 @@ typedef struct ConfigReader
 #define ConfigReaderGetSectionKv(section) ((section)->kvs[index])
 
 ConfigReader* ConfigReaderCreate(const char *fileName, int *errNo);
+ConfigReader* ConfigReaderCreateEx(const char *fileName, int flags, int *errNo);
+
+/*
+ * 确保section已经解析，CONFIG_READER_LAZY模式下section中的格式错误在这里返回
+ * 延迟模式下同名的section合并为一个，未解析的section的kvCount为0
+ * @return 0成功，ERR_KEY_NOT_FOUND不存在，其他为解析错误
+ */
+int ConfigReaderLoadSection(const ConfigReader *reader, const char *sectionName);
+
+#define CONFIG_CHANGE_ADDED 1
+#define CONFIG_CHANGE_REMOVED 2
+#define CONFIG_CHANGE_MODIFIED 3
+
+/*
+ * (section, key)变化的回调，新增时oldValue为NULL，删除时newValue为NULL
+ * 字符串只在回调期间有效
+ */
+typedef void (*ConfigChangeFunc)(void *ctx, int change, const char *sectionName,
+	const char *key, const char *oldValue, const char *newValue);
+
+/*
+ * 增量加载，以CONFIG_READER_LAZY模式加载fileName后与old逐个section比较内容hash，
+ * 内容未变的section共享old中已解析的kv，不重新解析；变化的section解析后逐个key比较，
+ * 对新增、删除和修改的(section, key)调用func，func在返回新reader之前调用
+ * 变化的section有格式错误时返回NULL，不调用func
+ * @param flags 总是加上CONFIG_READER_LAZY，忽略CONFIG_READER_ZERO_COPY和CONFIG_READER_PARALLEL
+ * @param old 之前由本函数或以CONFIG_READER_LAZY(不含ZERO_COPY)创建的reader，NULL时不比较；
+ *            old可以先于返回的reader销毁
+ */
+ConfigReader* ConfigReaderCreateDiff(const char *fileName, int flags, const ConfigReader *old,
+	ConfigChangeFunc func, void *ctx, int *errNo);
+
+/*
+ * 设置CONFIG_READER_PARALLEL使用的线程数，0(默认)表示使用在线CPU数
+ * 每个线程至少处理64KB，文件较小时自动减少线程数
+ */
+void ConfigReaderSetParallelism(int threads);
+
+/*
+ * 从fd或回调中流式读取并解析配置，支持管道、标准输入和解压后的数据流等，
+ * 行和值的长度不受限制。fd由调用者关闭
+ */
+ConfigReader* ConfigReaderCreateFromFd(int fd, int *errNo);
+ConfigReader* ConfigReaderCreateFromCallback(ConfigReadFunc readFunc, void *ctx, int *errNo);
 void ConfigReaderDestory(ConfigReader *reader);
 
 const char* ConfigReaderGetValue(const ConfigReader *reader,
 	const char *sectionName, const char *key);
 
+/*
+ * 查找(section, key)对应的kv，返回的地址在reader销毁前保持不变，
+ * 热点路径上可以只查找一次，之后通过ConfigHandleValue直接读取value
+ * @return 不存在时返回&ConfigKeyValueMissing，其key和value均为""
+ */
+const ConfigKeyValue* ConfigReaderLookupHandle(const ConfigReader *reader,
+	const char *sectionName, const char *key);
+
+extern const ConfigKeyValue ConfigKeyValueMissing;
+
+#define ConfigHandleValue(handle) ((handle)->value)
+#define ConfigHandleIsMissing(handle) ((handle) == &ConfigKeyValueMissing)
+
+/*
+ * 按类型读取value，解析结果缓存在kv上，重复读取不再解析
+ * errNo为0成功，ERR_KEY_NOT_FOUND不存在，ERR_VALUE_INVALID格式错误，失败时返回defaultValue
+ * 时长换算为毫秒，支持ms、s、m/min、h、d，没有单位时为毫秒，如"200ms"、"1.5s"
+ * 大小换算为字节，支持B、K/KB、M/MB、G/GB、T/TB，按1024进位，如"64MB"
+ * bool支持1/0、true/false、yes/no、on/off，不区分大小写
+ */
+int64_t ConfigHandleGetInt64(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo);
+double ConfigHandleGetDouble(const ConfigKeyValue *handle, double defaultValue, int *errNo);
+int ConfigHandleGetBool(const ConfigKeyValue *handle, int defaultValue, int *errNo);
+int64_t ConfigHandleGetDurationMs(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo);
+int64_t ConfigHandleGetSizeBytes(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo);
+
+/*
+ * 按','分隔value，每一项去掉两端的空白，value为空时*count为0
+ * 返回的数组在reader销毁前有效
+ */
+const char* const* ConfigHandleGetList(const ConfigKeyValue *handle, int *count, int *errNo);
+
+#define ConfigReaderGetInt64(reader, section, key, defaultValue, errNo) \
+	ConfigHandleGetInt64(ConfigReaderLookupHandle(reader, section, key), defaultValue, errNo)
+#define ConfigReaderGetDouble(reader, section, key, defaultValue, errNo) \
+	ConfigHandleGetDouble(ConfigReaderLookupHandle(reader, section, key), defaultValue, errNo)
+#define ConfigReaderGetBool(reader, section, key, defaultValue, errNo) \
+	ConfigHandleGetBool(ConfigReaderLookupHandle(reader, section, key), defaultValue, errNo)
+#define ConfigReaderGetDurationMs(reader, section, key, defaultValue, errNo) \
+	ConfigHandleGetDurationMs(ConfigReaderLookupHandle(reader, section, key), defaultValue, errNo)
+#define ConfigReaderGetSizeBytes(reader, section, key, defaultValue, errNo) \
+	ConfigHandleGetSizeBytes(ConfigReaderLookupHandle(reader, section, key), defaultValue, errNo)
+#define ConfigReaderGetList(reader, section, key, count, errNo) \
+	ConfigHandleGetList(ConfigReaderLookupHandle(reader, section, key), count, errNo)
+
+/*
+ * 把reader编译为二进制镜像，镜像中的section和kv已排序并带有索引和字符串池，
+ * 与映射地址无关。先写临时文件再重命名，正在使用旧镜像的进程不受影响
+ * @return 0成功
+ */
+int ConfigReaderWriteImage(const ConfigReader *reader, const char *fileName);
+
+/*
+ * 映射二进制镜像，不解析、不排序，查找直接在映射上进行，多个进程共享页缓存。
+ * 默认只检查头部和各表的范围，flags含CONFIG_READER_VERIFY_IMAGE时校验整个镜像。
+ * 返回的reader没有sections数组，ConfigReaderGetSection等宏不可用，
+ * 其余接口与ConfigReaderCreate得到的reader相同
+ */
+ConfigReader* ConfigReaderOpenImage(const char *fileName, int flags, int *errNo);
+
 void ConfigReaderPrint(const ConfigReader *configReader);
 
 #endif
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "config_reloader.h"
+#include "config_epoch.h"
+
+#define WATCH_EVENT_BUF_LEN 4096
+
+typedef struct ConfigReloadCallback
+{
+	ConfigChangeFunc func;
+	void *ctx;
+}ConfigReloadCallback;
+
+struct ConfigReloader
+{
+	char *fileName;
+	char *dirName;			// 监视的目录，编辑器通常以重命名的方式替换文件
+	const char *baseName;	// fileName中的文件名部分
+	int flags;
+	ConfigReader *current;	// 当前发布的配置，原子读写
+	ConfigEpoch epoch;		// 持有快照的读取方
+	unsigned int version;
+	int lastErr;
+	pthread_mutex_t lock;	// 串行化加载和回调的注册
+	ConfigReloadCallback *callbacks;
+	int callbackCount;
+	int inotifyFd;
+	int wakeFds[2];			// 通知监视线程退出的管道
+	pthread_t watcher;
+};
+
+static void ConfigReloaderNotify(void *ctx, int change, const char *sectionName,
+	const char *key, const char *oldValue, const char *newValue)
+{
+	const ConfigReloader *reloader = (const ConfigReloader*)ctx;
+	int i = 0;
+	for (i = 0; i < reloader->callbackCount; ++i)
+	{
+		reloader->callbacks[i].func(reloader->callbacks[i].ctx, change, sectionName,
+			key, oldValue, newValue);
+	}
+}
+
+/*
+ * 延迟模式下与当前配置做增量比较，只解析变化的section并通知回调
+ */
+static ConfigReader* ConfigReloaderLoad(ConfigReloader *reloader, int *errNo)
+{
+	if (reloader->flags & CONFIG_READER_LAZY)
+	{
+		return ConfigReaderCreateDiff(reloader->fileName, reloader->flags, reloader->current,
+			ConfigReloaderNotify, reloader, errNo);
+	}
+	return ConfigReaderCreateEx(reloader->fileName, reloader->flags, errNo);
+}
+
+int ConfigReloaderReload(ConfigReloader *reloader)
+{
+	if (reloader == NULL)
+	{
+		return ERR_CONFIG_NULL;
+	}
+
+	pthread_mutex_lock(&reloader->lock);
+	int errNo = 0;
+	ConfigReader *reader = ConfigReloaderLoad(reloader, &errNo);
+	if (reader == NULL)
+	{
+		__atomic_store_n(&reloader->lastErr, errNo, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&reloader->lock);
+		return errNo;
+	}
+
+	ConfigReader *old = __atomic_exchange_n(&reloader->current, reader, __ATOMIC_SEQ_CST);
+	// 等待所有在交换指针前登记的读取方Release
+	ConfigEpochSynchronize(&reloader->epoch);
+	ConfigReaderDestory(old);
+
+	__atomic_store_n(&reloader->lastErr, 0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&reloader->version, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&reloader->lock);
+	return 0;
+}
+
+/*
+ * 读取inotify事件，只关心配置文件本身的事件
+ * @return 1配置文件有变化，0没有变化
+ */
+static int ConfigReloaderReadEvents(ConfigReloader *reloader)
+{
+	char buf[WATCH_EVENT_BUF_LEN] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t n = read(reloader->inotifyFd, buf, sizeof(buf));
+	if (n <= 0)
+	{
+		return 0;
+	}
+
+	int changed = 0;
+	const char *pc = buf;
+	while (pc < buf + n)
+	{
+		const struct inotify_event *event = (const struct inotify_event*)pc;
+		if (event->len > 0 && strcmp(event->name, reloader->baseName) == 0)
+		{
+			changed = 1;
+		}
+		pc += sizeof(struct inotify_event) + event->len;
+	}
+	return changed;
+}
+
+static void* ConfigReloaderWatch(void *arg)
+{
+	ConfigReloader *reloader = (ConfigReloader*)arg;
+	while (1)
+	{
+		struct pollfd fds[2];
+		fds[0].fd = reloader->inotifyFd;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		fds[1].fd = reloader->wakeFds[0];
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		if (fds[1].revents != 0)
+		{
+			break;
+		}
+
+		if ((fds[0].revents & POLLIN) && ConfigReloaderReadEvents(reloader))
+		{
+			// 解析失败时保留旧的配置，错误记录在lastErr中
+			ConfigReloaderReload(reloader);
+		}
+	}
+	return NULL;
+}
+
+static int ConfigReloaderSplitPath(ConfigReloader *reloader, const char *fileName)
+{
+	reloader->fileName = strdup(fileName);
+	if (reloader->fileName == NULL)
+	{
+		return ERR_MALLOC_FAILED;
+	}
+
+	const char *slash = strrchr(fileName, '/');
+	if (slash == NULL)
+	{
+		reloader->dirName = strdup(".");
+		reloader->baseName = reloader->fileName;
+	}
+	else
+	{
+		size_t len = slash == fileName ? 1 : slash - fileName;
+		reloader->dirName = strndup(fileName, len);
+		reloader->baseName = reloader->fileName + (slash - fileName) + 1;
+	}
+	return reloader->dirName != NULL ? 0 : ERR_MALLOC_FAILED;
+}
+
+ConfigReloader* ConfigReloaderCreate(const char *fileName, int flags, int *errNo)
+{
+	if (fileName == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_CONFIG_NULL;
+		return NULL;
+	}
+
+	if (flags & CONFIG_READER_ZERO_COPY)
+	{
+		// 监视的文件会被原地改写，零拷贝的value会随之改变甚至访问时SIGBUS
+		if (errNo != NULL) *errNo = ERR_VALUE_INVALID;
+		return NULL;
+	}
+
+	ConfigReloader *reloader = (ConfigReloader*)calloc(1, sizeof(ConfigReloader));
+	if (reloader == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		return NULL;
+	}
+	reloader->flags = flags;
+	reloader->inotifyFd = -1;
+	reloader->wakeFds[0] = -1;
+	reloader->wakeFds[1] = -1;
+	pthread_mutex_init(&reloader->lock, NULL);
+
+	int ret = ConfigReloaderSplitPath(reloader, fileName);
+	if (ret == 0)
+	{
+		reloader->current = ConfigReloaderLoad(reloader, &ret);
+	}
+
+	if (ret == 0)
+	{
+		reloader->inotifyFd = inotify_init1(IN_CLOEXEC);
+		if (reloader->inotifyFd < 0 || pipe(reloader->wakeFds) != 0
+			|| inotify_add_watch(reloader->inotifyFd, reloader->dirName, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			ret = ERR_WATCH_CONFIG;
+		}
+	}
+
+	if (ret == 0 && pthread_create(&reloader->watcher, NULL, ConfigReloaderWatch, reloader) != 0)
+	{
+		ret = ERR_RELOADER_THREAD;
+	}
+
+	if (ret != 0)
+	{
+		if (errNo != NULL) *errNo = ret;
+		if (reloader->inotifyFd >= 0) close(reloader->inotifyFd);
+		if (reloader->wakeFds[0] >= 0) close(reloader->wakeFds[0]);
+		if (reloader->wakeFds[1] >= 0) close(reloader->wakeFds[1]);
+		ConfigReaderDestory(reloader->current);
+		pthread_mutex_destroy(&reloader->lock);
+		free(reloader->fileName);
+		free(reloader->dirName);
+		free(reloader);
+		return NULL;
+	}
+	return reloader;
+}
+
+void ConfigReloaderDestory(ConfigReloader *reloader)
+{
+	if (reloader == NULL)
+	{
+		return;
+	}
+
+	char c = 0;
+	while (write(reloader->wakeFds[1], &c, 1) < 0 && errno == EINTR)
+	{
+	}
+	pthread_join(reloader->watcher, NULL);
+
+	close(reloader->inotifyFd);
+	close(reloader->wakeFds[0]);
+	close(reloader->wakeFds[1]);
+	ConfigReaderDestory(reloader->current);
+	pthread_mutex_destroy(&reloader->lock);
+	free(reloader->callbacks);
+	free(reloader->fileName);
+	free(reloader->dirName);
+	free(reloader);
+}
+
+int ConfigReloaderAddCallback(ConfigReloader *reloader, ConfigChangeFunc func, void *ctx)
+{
+	if (reloader == NULL || func == NULL)
+	{
+		return ERR_CONFIG_NULL;
+	}
+
+	pthread_mutex_lock(&reloader->lock);
+	ConfigReloadCallback *callbacks = (ConfigReloadCallback*)realloc(reloader->callbacks,
+		sizeof(ConfigReloadCallback) * (reloader->callbackCount + 1));
+	if (callbacks == NULL)
+	{
+		pthread_mutex_unlock(&reloader->lock);
+		return ERR_MALLOC_FAILED;
+	}
+	callbacks[reloader->callbackCount].func = func;
+	callbacks[reloader->callbackCount].ctx = ctx;
+	reloader->callbacks = callbacks;
+	++reloader->callbackCount;
+	pthread_mutex_unlock(&reloader->lock);
+	return 0;
+}
+
+const ConfigReader* ConfigReloaderAcquire(ConfigReloader *reloader, int *token)
+{
+	*token = ConfigEpochEnter(&reloader->epoch);
+	return __atomic_load_n(&reloader->current, __ATOMIC_SEQ_CST);
+}
+
+void ConfigReloaderRelease(ConfigReloader *reloader, int token)
+{
+	ConfigEpochExit(&reloader->epoch, token);
+}
+
+unsigned int ConfigReloaderGetVersion(const ConfigReloader *reloader)
+{
+	return __atomic_load_n(&reloader->version, __ATOMIC_ACQUIRE);
+}
+
+int ConfigReloaderGetLastError(const ConfigReloader *reloader)
+{
+	return __atomic_load_n(&reloader->lastErr, __ATOMIC_RELAXED);
+}
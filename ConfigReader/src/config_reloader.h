@@ -0,0 +1,57 @@
+#ifndef _CONFIG_RELOADER_H
+#define _CONFIG_RELOADER_H
+
+#include "config_reader.h"
+
+#define ERR_WATCH_CONFIG -1007
+#define ERR_RELOADER_THREAD -1008
+
+/*
+ * 配置热加载
+ * 后台线程用inotify监视配置文件所在的目录，文件被写入或替换后重新解析，
+ * 解析成功后用原子指针交换发布新的ConfigReader，解析失败时保留旧的配置。
+ * 读取方通过Acquire/Release得到一致的快照，读取过程无锁，也不会被加载阻塞；
+ * 旧的ConfigReader在所有持有它的读取方Release后才销毁
+ */
+typedef struct ConfigReloader ConfigReloader;
+
+/*
+ * @param flags 传给ConfigReaderCreateEx的flags，不支持CONFIG_READER_ZERO_COPY，
+ *              文件可能被原地改写，含该flag时返回NULL，errNo为ERR_VALUE_INVALID
+ */
+ConfigReloader* ConfigReloaderCreate(const char *fileName, int flags, int *errNo);
+void ConfigReloaderDestory(ConfigReloader *reloader);
+
+/*
+ * 取得当前配置的快照，快照及从中取得的value和handle在Release前一直有效
+ * @param token 传给ConfigReloaderRelease的值
+ */
+const ConfigReader* ConfigReloaderAcquire(ConfigReloader *reloader, int *token);
+void ConfigReloaderRelease(ConfigReloader *reloader, int token);
+
+/*
+ * 立即重新加载，会等待持有旧配置的读取方全部Release
+ * @return 0成功，失败时返回ConfigReaderCreateEx的errNo
+ */
+int ConfigReloaderReload(ConfigReloader *reloader);
+
+/*
+ * 注册配置变化的回调，只在flags含CONFIG_READER_LAZY时生效
+ * 此时加载使用ConfigReaderCreateDiff，只解析变化的section，
+ * 在发布新配置之前对每个新增、删除和修改的(section, key)按注册顺序调用回调；
+ * 延迟模式的reader在创建时读入文件内容，文件被原地改写或替换都能正确比较
+ * 回调在加载线程中执行，不能调用ConfigReloaderReload和ConfigReloaderAddCallback
+ */
+int ConfigReloaderAddCallback(ConfigReloader *reloader, ConfigChangeFunc func, void *ctx);
+
+/*
+ * 成功加载的次数，初始加载为0
+ */
+unsigned int ConfigReloaderGetVersion(const ConfigReloader *reloader);
+
+/*
+ * 最近一次加载的errNo，0表示成功
+ */
+int ConfigReloaderGetLastError(const ConfigReloader *reloader);
+
+#endif
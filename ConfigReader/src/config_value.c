@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config_reader.h"
+#include "config_value.h"
+
+#define IS_SPACE_CHAR(c) ((c) == ' '||(c) == '\t')
+
+typedef struct ConfigValueUnit
+{
+	const char *name;
+	int64_t scale;
+}ConfigValueUnit;
+
+// 时长的单位，换算为毫秒，没有单位时为毫秒
+static const ConfigValueUnit durationUnits[] = {
+	{"", 1}, {"ms", 1}, {"s", 1000}, {"m", 60 * 1000}, {"min", 60 * 1000},
+	{"h", 3600 * 1000}, {"d", 24 * 3600 * 1000}, {NULL, 0}
+};
+
+// 大小的单位，换算为字节，按1024进位
+static const ConfigValueUnit sizeUnits[] = {
+	{"", 1}, {"b", 1},
+	{"k", 1LL << 10}, {"kb", 1LL << 10}, {"kib", 1LL << 10},
+	{"m", 1LL << 20}, {"mb", 1LL << 20}, {"mib", 1LL << 20},
+	{"g", 1LL << 30}, {"gb", 1LL << 30}, {"gib", 1LL << 30},
+	{"t", 1LL << 40}, {"tb", 1LL << 40}, {"tib", 1LL << 40}, {NULL, 0}
+};
+
+/*
+ * 逗号分隔的列表，items指向紧跟在数组后面的文本
+ */
+typedef struct ConfigValueList
+{
+	int count;
+	const char *items[1];
+}ConfigValueList;
+
+/*
+ * 一个value按各种类型解析的结果，第一次类型化读取时生成，之后只读
+ * 列表需要额外分配内存，第一次读取列表时才生成
+ */
+struct ConfigParsedValue
+{
+	int int64Err;
+	int64_t int64Value;
+	int doubleErr;
+	double doubleValue;
+	int boolErr;
+	int boolValue;
+	int durationErr;
+	int64_t durationMs;
+	int sizeErr;
+	int64_t sizeBytes;
+	ConfigValueList *list;
+};
+
+static int ParseInt64(const char *str, int64_t *value)
+{
+	if (str[0] == '\0')
+	{
+		return ERR_VALUE_INVALID;
+	}
+
+	// 只有明确的0x前缀按十六进制解析，前导0仍按十进制，"010"为10
+	const char *digits = (str[0] == '-' || str[0] == '+') ? str + 1 : str;
+	int base = (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) ? 16 : 10;
+	char *end = NULL;
+	errno = 0;
+	long long n = strtoll(str, &end, base);
+	if (*end != '\0' || errno == ERANGE)
+	{
+		return ERR_VALUE_INVALID;
+	}
+	*value = n;
+	return 0;
+}
+
+static int ParseDouble(const char *str, double *value)
+{
+	if (str[0] == '\0')
+	{
+		return ERR_VALUE_INVALID;
+	}
+
+	char *end = NULL;
+	errno = 0;
+	double d = strtod(str, &end);
+	if (*end != '\0' || errno == ERANGE)
+	{
+		return ERR_VALUE_INVALID;
+	}
+	*value = d;
+	return 0;
+}
+
+static int ParseBool(const char *str, int *value)
+{
+	static const char *trues[] = {"1", "true", "yes", "on", NULL};
+	static const char *falses[] = {"0", "false", "no", "off", NULL};
+	int i = 0;
+	for (i = 0; trues[i] != NULL; ++i)
+	{
+		if (strcasecmp(str, trues[i]) == 0)
+		{
+			*value = 1;
+			return 0;
+		}
+		if (strcasecmp(str, falses[i]) == 0)
+		{
+			*value = 0;
+			return 0;
+		}
+	}
+	return ERR_VALUE_INVALID;
+}
+
+/*
+ * 解析"数字[单位]"，数字可以带小数，数字和单位之间可以有空格
+ */
+static int ParseWithUnit(const char *str, const ConfigValueUnit *units, int64_t *value)
+{
+	char *end = NULL;
+	errno = 0;
+	double n = strtod(str, &end);
+	// strtod接受"nan"和"inf"，NaN和任何数比较都为假，需要先排除
+	if (end == str || errno == ERANGE || !isfinite(n) || n < 0)
+	{
+		return ERR_VALUE_INVALID;
+	}
+
+	while (IS_SPACE_CHAR(*end))
+	{
+		++end;
+	}
+
+	const ConfigValueUnit *unit = units;
+	while (unit->name != NULL && strcasecmp(end, unit->name) != 0)
+	{
+		++unit;
+	}
+
+	if (unit->name == NULL || n * unit->scale >= 9.2e18)
+	{
+		return ERR_VALUE_INVALID;
+	}
+	*value = (int64_t)(n * unit->scale + 0.5);
+	return 0;
+}
+
+static ConfigParsedValue* ConfigParsedValueCreate(const char *str)
+{
+	ConfigParsedValue *parsed = (ConfigParsedValue*)malloc(sizeof(ConfigParsedValue));
+	if (parsed == NULL)
+	{
+		return NULL;
+	}
+
+	parsed->int64Value = 0;
+	parsed->int64Err = ParseInt64(str, &parsed->int64Value);
+	parsed->doubleValue = 0.0;
+	parsed->doubleErr = ParseDouble(str, &parsed->doubleValue);
+	parsed->boolValue = 0;
+	parsed->boolErr = ParseBool(str, &parsed->boolValue);
+	parsed->durationMs = 0;
+	parsed->durationErr = ParseWithUnit(str, durationUnits, &parsed->durationMs);
+	parsed->sizeBytes = 0;
+	parsed->sizeErr = ParseWithUnit(str, sizeUnits, &parsed->sizeBytes);
+	parsed->list = NULL;
+	return parsed;
+}
+
+static ConfigValueList* ConfigValueListCreate(const char *str)
+{
+	int count = 0;
+	size_t len = strlen(str);
+	const char *pc = str;
+	if (len > 0)
+	{
+		count = 1;
+		while ((pc = strchr(pc, ',')) != NULL)
+		{
+			++count;
+			++pc;
+		}
+	}
+
+	size_t head = sizeof(ConfigValueList) + sizeof(const char*) * count;
+	ConfigValueList *list = (ConfigValueList*)malloc(head + len + 1);
+	if (list == NULL)
+	{
+		return NULL;
+	}
+
+	// 复制一份文本，把每个','替换为'\0'并去掉每项两端的空白
+	char *text = (char*)list + head;
+	memcpy(text, str, len + 1);
+	list->count = count;
+	int i = 0;
+	char *item = text;
+	for (i = 0; i < count; ++i)
+	{
+		char *comma = strchr(item, ',');
+		char *itemEnd = comma != NULL ? comma : item + strlen(item);
+		char *next = comma != NULL ? comma + 1 : itemEnd;
+		while (item < itemEnd && IS_SPACE_CHAR(*item))
+		{
+			++item;
+		}
+		while (itemEnd > item && IS_SPACE_CHAR(itemEnd[-1]))
+		{
+			--itemEnd;
+		}
+		*itemEnd = '\0';
+		list->items[i] = item;
+		item = next;
+	}
+	return list;
+}
+
+/*
+ * 取出kv的解析结果，不存在时解析并用CAS发布，多个线程同时解析时只保留一份
+ */
+static ConfigParsedValue* ConfigHandleParsed(const ConfigKeyValue *handle, int *errNo)
+{
+	ConfigKeyValue *kv = (ConfigKeyValue*)handle;
+	if (ConfigHandleIsMissing(handle))
+	{
+		if (errNo != NULL) *errNo = ERR_KEY_NOT_FOUND;
+		return NULL;
+	}
+
+	ConfigParsedValue *parsed = __atomic_load_n(&kv->parsed, __ATOMIC_ACQUIRE);
+	if (parsed != NULL)
+	{
+		return parsed;
+	}
+
+	parsed = ConfigParsedValueCreate(kv->value);
+	if (parsed == NULL)
+	{
+		if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+		return NULL;
+	}
+
+	ConfigParsedValue *expected = NULL;
+	if (!__atomic_compare_exchange_n(&kv->parsed, &expected, parsed, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		free(parsed);
+		return expected;
+	}
+	return parsed;
+}
+
+int64_t ConfigHandleGetInt64(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo)
+{
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return defaultValue;
+	}
+	if (errNo != NULL) *errNo = parsed->int64Err;
+	return parsed->int64Err == 0 ? parsed->int64Value : defaultValue;
+}
+
+double ConfigHandleGetDouble(const ConfigKeyValue *handle, double defaultValue, int *errNo)
+{
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return defaultValue;
+	}
+	if (errNo != NULL) *errNo = parsed->doubleErr;
+	return parsed->doubleErr == 0 ? parsed->doubleValue : defaultValue;
+}
+
+int ConfigHandleGetBool(const ConfigKeyValue *handle, int defaultValue, int *errNo)
+{
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return defaultValue;
+	}
+	if (errNo != NULL) *errNo = parsed->boolErr;
+	return parsed->boolErr == 0 ? parsed->boolValue : defaultValue;
+}
+
+int64_t ConfigHandleGetDurationMs(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo)
+{
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return defaultValue;
+	}
+	if (errNo != NULL) *errNo = parsed->durationErr;
+	return parsed->durationErr == 0 ? parsed->durationMs : defaultValue;
+}
+
+int64_t ConfigHandleGetSizeBytes(const ConfigKeyValue *handle, int64_t defaultValue, int *errNo)
+{
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return defaultValue;
+	}
+	if (errNo != NULL) *errNo = parsed->sizeErr;
+	return parsed->sizeErr == 0 ? parsed->sizeBytes : defaultValue;
+}
+
+const char* const* ConfigHandleGetList(const ConfigKeyValue *handle, int *count, int *errNo)
+{
+	*count = 0;
+	ConfigParsedValue *parsed = ConfigHandleParsed(handle, errNo);
+	if (parsed == NULL)
+	{
+		return NULL;
+	}
+
+	ConfigValueList *list = __atomic_load_n(&parsed->list, __ATOMIC_ACQUIRE);
+	if (list == NULL)
+	{
+		list = ConfigValueListCreate(handle->value);
+		if (list == NULL)
+		{
+			if (errNo != NULL) *errNo = ERR_MALLOC_FAILED;
+			return NULL;
+		}
+
+		ConfigValueList *expected = NULL;
+		if (!__atomic_compare_exchange_n(&parsed->list, &expected, list, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			free(list);
+			list = expected;
+		}
+	}
+
+	if (errNo != NULL) *errNo = 0;
+	*count = list->count;
+	return list->items;
+}
+
+void ConfigParsedValueDestory(ConfigParsedValue *parsed)
+{
+	if (parsed == NULL)
+	{
+		return;
+	}
+	free(parsed->list);
+	free(parsed);
+}
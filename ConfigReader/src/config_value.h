@@ -0,0 +1,11 @@
+#ifndef _CONFIG_VALUE_H
+#define _CONFIG_VALUE_H
+
+#include "config_reader.h"
+
+/*
+ * 释放kv上缓存的类型化解析结果，只在销毁reader时调用
+ */
+void ConfigParsedValueDestory(ConfigParsedValue *parsed);
+
+#endif
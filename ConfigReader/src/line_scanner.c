@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_scanner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LINE_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+#define MARK_NONE 0
+#define MARK_LINE_END 1
+#define MARK_COMMENT 2
+
+typedef const char*(*ScanFunc)(const char *begin, const char *end, LineMarks *marks);
+
+static ScanFunc scanFunc = NULL;
+static int scanImpl = LINE_SCANNER_AUTO;
+
+/*
+ * 记录一个可能的特殊字符
+ */
+static inline int LineScannerMark(const char *pc, const char *end, LineMarks *marks)
+{
+	switch (*pc)
+	{
+	case '\n':
+		return MARK_LINE_END;
+	case '=':
+		if (marks->equal == NULL)
+		{
+			marks->equal = pc;
+		}
+		break;
+	case '[':
+		if (marks->leftBracket == NULL)
+		{
+			marks->leftBracket = pc;
+		}
+		break;
+	case ']':
+		if (marks->rightBracket == NULL)
+		{
+			marks->rightBracket = pc;
+		}
+		break;
+	case '#':
+		marks->comment = pc;
+		return MARK_COMMENT;
+	case '/':
+		if (pc + 1 < end && pc[1] == '/')
+		{
+			marks->comment = pc;
+			return MARK_COMMENT;
+		}
+		break;
+	default:
+		break;
+	}
+	return MARK_NONE;
+}
+
+/*
+ * 注释之后只需要找到行尾
+ */
+static const char* LineScannerSkipComment(const char *pc, const char *end)
+{
+	const char *lineEnd = (const char*)memchr(pc, '\n', end - pc);
+	return lineEnd != NULL ? lineEnd : end;
+}
+
+static const char* LineScanScalar(const char *begin, const char *end, LineMarks *marks)
+{
+	const char *pc = NULL;
+	for (pc = begin; pc < end; ++pc)
+	{
+		int ret = LineScannerMark(pc, end, marks);
+		if (ret == MARK_LINE_END)
+		{
+			return pc;
+		}
+		else if (ret == MARK_COMMENT)
+		{
+			return LineScannerSkipComment(pc, end);
+		}
+	}
+	return end;
+}
+
+#ifdef LINE_SCANNER_X86
+__attribute__((target("sse2")))
+static const char* LineScanSse2(const char *begin, const char *end, LineMarks *marks)
+{
+	const __m128i newLine = _mm_set1_epi8('\n');
+	const __m128i equal = _mm_set1_epi8('=');
+	const __m128i leftBracket = _mm_set1_epi8('[');
+	const __m128i rightBracket = _mm_set1_epi8(']');
+	const __m128i sharp = _mm_set1_epi8('#');
+	const __m128i slash = _mm_set1_epi8('/');
+
+	const char *p = begin;
+	while (end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i hit = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, newLine), _mm_cmpeq_epi8(v, equal)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, leftBracket), _mm_cmpeq_epi8(v, rightBracket)));
+		hit = _mm_or_si128(hit,
+			_mm_or_si128(_mm_cmpeq_epi8(v, sharp), _mm_cmpeq_epi8(v, slash)));
+
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+		while (mask != 0)
+		{
+			const char *pc = p + __builtin_ctz(mask);
+			mask &= mask - 1;
+			int ret = LineScannerMark(pc, end, marks);
+			if (ret == MARK_LINE_END)
+			{
+				return pc;
+			}
+			else if (ret == MARK_COMMENT)
+			{
+				return LineScannerSkipComment(pc, end);
+			}
+		}
+		p += 16;
+	}
+	// 不足16字节的尾部
+	return LineScanScalar(p, end, marks);
+}
+
+__attribute__((target("avx2")))
+static const char* LineScanAvx2(const char *begin, const char *end, LineMarks *marks)
+{
+	const __m256i newLine = _mm256_set1_epi8('\n');
+	const __m256i equal = _mm256_set1_epi8('=');
+	const __m256i leftBracket = _mm256_set1_epi8('[');
+	const __m256i rightBracket = _mm256_set1_epi8(']');
+	const __m256i sharp = _mm256_set1_epi8('#');
+	const __m256i slash = _mm256_set1_epi8('/');
+
+	const char *p = begin;
+	while (end - p >= 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i hit = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, newLine), _mm256_cmpeq_epi8(v, equal)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, leftBracket), _mm256_cmpeq_epi8(v, rightBracket)));
+		hit = _mm256_or_si256(hit,
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, sharp), _mm256_cmpeq_epi8(v, slash)));
+
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+		while (mask != 0)
+		{
+			const char *pc = p + __builtin_ctz(mask);
+			mask &= mask - 1;
+			int ret = LineScannerMark(pc, end, marks);
+			if (ret == MARK_LINE_END)
+			{
+				return pc;
+			}
+			else if (ret == MARK_COMMENT)
+			{
+				return LineScannerSkipComment(pc, end);
+			}
+		}
+		p += 32;
+	}
+	// 不足32字节的尾部交给SSE2处理
+	return LineScanSse2(p, end, marks);
+}
+#endif
+
+static int LineScannerSupported(int impl)
+{
+	switch (impl)
+	{
+	case LINE_SCANNER_SCALAR:
+		return 1;
+#ifdef LINE_SCANNER_X86
+	case LINE_SCANNER_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case LINE_SCANNER_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return 0;
+	}
+}
+
+static ScanFunc LineScannerFunc(int impl)
+{
+	switch (impl)
+	{
+#ifdef LINE_SCANNER_X86
+	case LINE_SCANNER_SSE2:
+		return LineScanSse2;
+	case LINE_SCANNER_AVX2:
+		return LineScanAvx2;
+#endif
+	default:
+		return LineScanScalar;
+	}
+}
+
+int LineScannerSetImpl(int impl)
+{
+	if (impl == LINE_SCANNER_AUTO)
+	{
+		impl = LINE_SCANNER_SCALAR;
+		if (LineScannerSupported(LINE_SCANNER_AVX2))
+		{
+			impl = LINE_SCANNER_AVX2;
+		}
+		else if (LineScannerSupported(LINE_SCANNER_SSE2))
+		{
+			impl = LINE_SCANNER_SSE2;
+		}
+	}
+	else if (!LineScannerSupported(impl))
+	{
+		return -1;
+	}
+
+	__atomic_store_n(&scanImpl, impl, __ATOMIC_RELAXED);
+	__atomic_store_n(&scanFunc, LineScannerFunc(impl), __ATOMIC_RELEASE);
+	return 0;
+}
+
+int LineScannerGetImpl(void)
+{
+	if (__atomic_load_n(&scanFunc, __ATOMIC_ACQUIRE) == NULL)
+	{
+		LineScannerSetImpl(LINE_SCANNER_AUTO);
+	}
+	return __atomic_load_n(&scanImpl, __ATOMIC_RELAXED);
+}
+
+const char* LineScannerScan(const char *begin, const char *end, LineMarks *marks)
+{
+	ScanFunc func = __atomic_load_n(&scanFunc, __ATOMIC_ACQUIRE);
+	if (func == NULL)
+	{
+		// 多个线程同时初始化时写入的是同一个值
+		LineScannerSetImpl(LINE_SCANNER_AUTO);
+		func = __atomic_load_n(&scanFunc, __ATOMIC_ACQUIRE);
+	}
+
+	marks->equal = NULL;
+	marks->leftBracket = NULL;
+	marks->rightBracket = NULL;
+	marks->comment = NULL;
+	return func(begin, end, marks);
+}
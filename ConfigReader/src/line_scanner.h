@@ -0,0 +1,36 @@
+#ifndef _LINE_SCANNER_H
+#define _LINE_SCANNER_H
+
+// 扫描器的实现
+#define LINE_SCANNER_AUTO 0		// 根据CPU自动选择
+#define LINE_SCANNER_SCALAR 1	// 逐字节扫描
+#define LINE_SCANNER_SSE2 2		// 每次扫描16字节
+#define LINE_SCANNER_AVX2 3		// 每次扫描32字节
+
+/*
+ * 一行中特殊字符第一次出现的位置，不存在时为NULL
+ * '='、'['和']'只记录注释之前的位置
+ */
+typedef struct LineMarks
+{
+	const char *equal;
+	const char *leftBracket;
+	const char *rightBracket;
+	const char *comment;	// '#'或"//"的位置
+}LineMarks;
+
+/*
+ * 扫描从begin开始的一行，用SIMD指令按块比较'\n'、'='、'['、']'、'#'和'/'，
+ * 再根据得到的位掩码逐个处理命中的位置，每个字节只读取一次
+ * @return 行尾'\n'的地址，没有'\n'时返回end
+ */
+const char* LineScannerScan(const char *begin, const char *end, LineMarks *marks);
+
+/*
+ * 指定扫描器的实现，主要用于测试和性能对比
+ * @return 0成功，-1当前CPU不支持该实现
+ */
+int LineScannerSetImpl(int impl);
+int LineScannerGetImpl(void);
+
+#endif
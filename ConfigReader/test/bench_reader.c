@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "config_reader.h"
+
+/*
+ * ConfigReader的基准测试，生成合成的ini文件，测量加载耗时、峰值内存和查找延迟
+ * 结果以一行JSON输出，便于比较解析器改动前后的数据
+ * 用法: bench_reader [-s 段数] [-k 每段key数] [-K key长度] [-V value长度]
+ *       [-c 注释行百分比] [-l 长行百分比] [-L 长行长度] [-f flags]
+ *       [-r 加载轮数] [-t 查找线程数] [-n 每线程查找次数]
+ */
+
+typedef struct BenchOptions
+{
+	int sections;
+	int keysPerSection;
+	int keyLen;
+	int valueLen;
+	int commentPercent;		// 每个kv前插入注释行的概率
+	int longPercent;		// value为长行的概率
+	int longLen;
+	int flags;				// 传给ConfigReaderCreateEx
+	int rounds;
+	int threads;
+	int ops;
+}BenchOptions;
+
+typedef struct LookupTask
+{
+	const ConfigReader *reader;
+	const BenchOptions *options;
+	pthread_barrier_t *barrier;
+	unsigned int seed;
+	int miss;			// 1查找不存在的key
+	double *latency;	// 每次查找的耗时，纳秒
+	const char *lastValue;
+}LookupTask;
+
+typedef struct LatencyStat
+{
+	double mean;
+	double p50;
+	double p99;
+	double max;
+}LatencyStat;
+
+static double NowSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long PeakRssKb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static unsigned int NextRandom(unsigned int *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+/*
+ * 生成的名字为前缀加编号，不足len时用'_'补齐
+ */
+static int MakeName(char *buf, const char *prefix, int id, int len)
+{
+	int n = sprintf(buf, "%s%d", prefix, id);
+	while (n < len)
+	{
+		buf[n++] = '_';
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+/*
+ * 直接写文件，不在内存中保留整个配置，避免影响峰值内存的统计
+ * @return 写入的字节数，失败返回0
+ */
+static size_t GenerateConfig(const char *fileName, const BenchOptions *options)
+{
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL)
+	{
+		return 0;
+	}
+
+	int maxLen = options->longLen > options->valueLen ? options->longLen : options->valueLen;
+	char *value = (char*)malloc(maxLen + 1);
+	char key[256] = {'\0'};
+	if (value == NULL)
+	{
+		fclose(fp);
+		return 0;
+	}
+	memset(value, 'v', maxLen);
+
+	unsigned int seed = 2463534242u;
+	size_t bytes = 0;
+	int i = 0;
+	int j = 0;
+	for (i = 0; i < options->sections; ++i)
+	{
+		bytes += fprintf(fp, "[section_%d]\n", i);
+		for (j = 0; j < options->keysPerSection; ++j)
+		{
+			if ((int)(NextRandom(&seed) % 100) < options->commentPercent)
+			{
+				bytes += fprintf(fp, "# comment for key %d in section %d\n", j, i);
+			}
+
+			int len = (int)(NextRandom(&seed) % 100) < options->longPercent ?
+				options->longLen : options->valueLen;
+			MakeName(key, "key_", j, options->keyLen);
+			bytes += fprintf(fp, "%s = %.*s\n", key, len, value);
+		}
+	}
+
+	free(value);
+	if (fclose(fp) != 0)
+	{
+		return 0;
+	}
+	return bytes;
+}
+
+static void* LookupWorker(void *arg)
+{
+	LookupTask *task = (LookupTask*)arg;
+	const BenchOptions *options = task->options;
+	char sectionName[64] = {'\0'};
+	char key[256] = {'\0'};
+	pthread_barrier_wait(task->barrier);
+
+	int i = 0;
+	for (i = 0; i < options->ops; ++i)
+	{
+		sprintf(sectionName, "section_%u", NextRandom(&task->seed) % options->sections);
+		int id = NextRandom(&task->seed) % options->keysPerSection;
+		MakeName(key, task->miss ? "missing_" : "key_", id, options->keyLen);
+
+		double start = NowSeconds();
+		task->lastValue = ConfigReaderGetValue(task->reader, sectionName, key);
+		task->latency[i] = (NowSeconds() - start) * 1e9;
+	}
+	return NULL;
+}
+
+static int CmpDouble(const void *a, const void *b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static LatencyStat Summarize(double *latency, size_t count)
+{
+	LatencyStat stat = {0.0, 0.0, 0.0, 0.0};
+	if (count == 0)
+	{
+		return stat;
+	}
+
+	size_t i = 0;
+	for (i = 0; i < count; ++i)
+	{
+		stat.mean += latency[i];
+	}
+	stat.mean /= count;
+	qsort(latency, count, sizeof(double), CmpDouble);
+	stat.p50 = latency[count / 2];
+	stat.p99 = latency[count * 99 / 100];
+	stat.max = latency[count - 1];
+	return stat;
+}
+
+/*
+ * 多个线程同时查找，返回所有线程的延迟统计
+ */
+static int RunLookup(const ConfigReader *reader, const BenchOptions *options, int miss,
+	LatencyStat *stat, double *wall)
+{
+	size_t total = (size_t)options->threads * options->ops;
+	double *latency = (double*)malloc(sizeof(double) * (total + 1));
+	LookupTask *tasks = (LookupTask*)calloc(options->threads, sizeof(LookupTask));
+	pthread_t *tids = (pthread_t*)calloc(options->threads, sizeof(pthread_t));
+	if (latency == NULL || tasks == NULL || tids == NULL)
+	{
+		free(latency);
+		free(tasks);
+		free(tids);
+		return -1;
+	}
+
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, options->threads + 1);
+	int i = 0;
+	for (i = 0; i < options->threads; ++i)
+	{
+		tasks[i].reader = reader;
+		tasks[i].options = options;
+		tasks[i].barrier = &barrier;
+		tasks[i].seed = 88172645u + i * 7919u + miss;
+		tasks[i].miss = miss;
+		tasks[i].latency = latency + (size_t)i * options->ops;
+		if (pthread_create(tids + i, NULL, LookupWorker, tasks + i) != 0)
+		{
+			// 已创建的线程阻塞在barrier上，无法继续
+			fprintf(stderr, "create lookup thread failed\n");
+			exit(1);
+		}
+	}
+
+	double start = NowSeconds();
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < options->threads; ++i)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	*wall = NowSeconds() - start;
+	*stat = Summarize(latency, total);
+
+	pthread_barrier_destroy(&barrier);
+	free(latency);
+	free(tasks);
+	free(tids);
+	return 0;
+}
+
+static void PrintLatency(const char *name, const LatencyStat *stat, double opsPerSec)
+{
+	printf("\"%s\":{\"mean_ns\":%.1f,\"p50_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f,\"ops_per_sec\":%.0f}",
+		name, stat->mean, stat->p50, stat->p99, stat->max, opsPerSec);
+}
+
+static int ParseOptions(int argc, char *argv[], BenchOptions *options)
+{
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "s:k:K:V:c:l:L:f:r:t:n:")) != -1)
+	{
+		int value = optarg != NULL ? (int)strtol(optarg, NULL, 0) : 0;
+		switch (opt)
+		{
+		case 's': options->sections = value; break;
+		case 'k': options->keysPerSection = value; break;
+		case 'K': options->keyLen = value; break;
+		case 'V': options->valueLen = value; break;
+		case 'c': options->commentPercent = value; break;
+		case 'l': options->longPercent = value; break;
+		case 'L': options->longLen = value; break;
+		case 'f': options->flags = value; break;
+		case 'r': options->rounds = value; break;
+		case 't': options->threads = value; break;
+		case 'n': options->ops = value; break;
+		default: return -1;
+		}
+	}
+
+	if (options->sections <= 0 || options->keysPerSection <= 0 || options->keyLen > 200
+		|| options->valueLen < 0 || options->longLen < 0 || options->rounds <= 0
+		|| options->threads <= 0 || options->ops <= 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchOptions options = {1000, 50, 16, 32, 10, 1, 4096, 0, 3, 4, 200000};
+	if (ParseOptions(argc, argv, &options) != 0)
+	{
+		fprintf(stderr, "usage: %s [-s sections] [-k keys] [-K keyLen] [-V valueLen] [-c comment%%]"
+			" [-l long%%] [-L longLen] [-f flags] [-r rounds] [-t threads] [-n ops]\n", argv[0]);
+		return 1;
+	}
+
+	char fileName[] = "/tmp/bench_reader_XXXXXX";
+	int fd = mkstemp(fileName);
+	if (fd < 0)
+	{
+		fprintf(stderr, "create temp file failed\n");
+		return 1;
+	}
+	close(fd);
+
+	size_t bytes = GenerateConfig(fileName, &options);
+	if (bytes == 0)
+	{
+		fprintf(stderr, "write config file failed\n");
+		unlink(fileName);
+		return 1;
+	}
+
+	// 最后一轮的reader保留给查找测试
+	long rssBefore = PeakRssKb();
+	double best = 0.0;
+	double sum = 0.0;
+	ConfigReader *reader = NULL;
+	int round = 0;
+	for (round = 0; round < options.rounds; ++round)
+	{
+		ConfigReaderDestory(reader);
+		int errNo = 0;
+		double start = NowSeconds();
+		reader = ConfigReaderCreateEx(fileName, options.flags, &errNo);
+		double cost = NowSeconds() - start;
+		if (reader == NULL)
+		{
+			fprintf(stderr, "config reader create failed, errNo[%d]\n", errNo);
+			unlink(fileName);
+			return 1;
+		}
+		sum += cost;
+		best = (round == 0 || cost < best) ? cost : best;
+	}
+	long peakRss = PeakRssKb();
+	unlink(fileName);
+
+	LatencyStat hit;
+	LatencyStat miss;
+	double hitWall = 0.0;
+	double missWall = 0.0;
+	if (RunLookup(reader, &options, 0, &hit, &hitWall) != 0
+		|| RunLookup(reader, &options, 1, &miss, &missWall) != 0)
+	{
+		fprintf(stderr, "malloc failed\n");
+		ConfigReaderDestory(reader);
+		return 1;
+	}
+	double totalOps = (double)options.threads * options.ops;
+
+	printf("{\"config\":{\"sections\":%d,\"keys_per_section\":%d,\"key_len\":%d,\"value_len\":%d,"
+		"\"comment_pct\":%d,\"long_line_pct\":%d,\"long_line_len\":%d,\"bytes\":%zu},",
+		options.sections, options.keysPerSection, options.keyLen, options.valueLen,
+		options.commentPercent, options.longPercent, options.longLen, bytes);
+	printf("\"create\":{\"flags\":%d,\"rounds\":%d,\"best_ms\":%.3f,\"mean_ms\":%.3f,"
+		"\"mb_per_sec\":%.1f,\"rss_before_kb\":%ld,\"peak_rss_kb\":%ld},",
+		options.flags, options.rounds, best * 1e3, sum / options.rounds * 1e3,
+		bytes / best / 1048576.0, rssBefore, peakRss);
+	printf("\"lookup\":{\"threads\":%d,\"ops_per_thread\":%d,", options.threads, options.ops);
+	PrintLatency("hit", &hit, totalOps / hitWall);
+	printf(",");
+	PrintLatency("miss", &miss, totalOps / missWall);
+	printf("}}\n");
+
+	ConfigReaderDestory(reader);
+	return 0;
+}
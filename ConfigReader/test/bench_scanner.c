@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config_reader.h"
+#include "line_scanner.h"
+
+#define ROUNDS 3
+
+static const char *implNames[] = {"auto", "scalar", "sse2", "avx2"};
+
+static double NowSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * 生成大小约为size的配置文本，包含section、长短不一的kv和注释
+ */
+static char* GenerateConfig(size_t size, size_t *len)
+{
+	char *buf = (char*)malloc(size + 256);
+	if (buf == NULL)
+	{
+		return NULL;
+	}
+
+	size_t used = 0;
+	unsigned int i = 0;
+	while (used < size)
+	{
+		if (i % 50 == 0)
+		{
+			used += sprintf(buf + used, "\n[section_%u]  # section comment\n", i / 50);
+		}
+		else if (i % 7 == 0)
+		{
+			used += sprintf(buf + used, "// line comment %u\n", i);
+		}
+		else if (i % 5 == 0)
+		{
+			used += sprintf(buf + used, "long_key_%u = /usr/local/share/app/%u/data/file_%u.dat,"
+				"/var/lib/app/%u/cache\n", i, i, i * 31, i);
+		}
+		else
+		{
+			used += sprintf(buf + used, "key_%u = value_%u\n", i, i * 17);
+		}
+		++i;
+	}
+	*len = used;
+	return buf;
+}
+
+/*
+ * 只运行扫描器，返回所有行标记位置的校验和，用于比较各实现的结果
+ */
+static size_t ScanAll(const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	const char *line = buf;
+	size_t sum = 0;
+	LineMarks marks;
+	while (line < end)
+	{
+		const char *lineEnd = LineScannerScan(line, end, &marks);
+		sum += (lineEnd - buf);
+		sum += marks.equal != NULL ? (size_t)(marks.equal - buf) : 0;
+		sum += marks.leftBracket != NULL ? (size_t)(marks.leftBracket - buf) : 0;
+		sum += marks.rightBracket != NULL ? (size_t)(marks.rightBracket - buf) : 0;
+		sum += marks.comment != NULL ? (size_t)(marks.comment - buf) : 0;
+		line = lineEnd + 1;
+	}
+	return sum;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size = 32;
+	if (argc > 1)
+	{
+		size = strtoul(argv[1], NULL, 10);
+	}
+	size *= 1024 * 1024;
+
+	size_t len = 0;
+	char *buf = GenerateConfig(size, &len);
+	if (buf == NULL)
+	{
+		printf("generate config failed\n");
+		return 0;
+	}
+
+	char fileName[] = "/tmp/bench_scanner_XXXXXX";
+	int fd = mkstemp(fileName);
+	if (fd < 0 || write(fd, buf, len) != (ssize_t)len)
+	{
+		printf("write config file failed\n");
+		free(buf);
+		return 0;
+	}
+	close(fd);
+
+	printf("config size: %.1f MB\n", len / 1048576.0);
+	printf("impl\tscan GB/s\tcreate GB/s\tchecksum\n");
+
+	int impl = 0;
+	for (impl = LINE_SCANNER_SCALAR; impl <= LINE_SCANNER_AVX2; ++impl)
+	{
+		if (LineScannerSetImpl(impl) != 0)
+		{
+			printf("%s\tunsupported\n", implNames[impl]);
+			continue;
+		}
+
+		// 取多轮中最快的一次
+		double scanBest = 0.0;
+		double createBest = 0.0;
+		size_t sum = 0;
+		int round = 0;
+		for (round = 0; round < ROUNDS; ++round)
+		{
+			double start = NowSeconds();
+			sum = ScanAll(buf, len);
+			double cost = NowSeconds() - start;
+			if (round == 0 || cost < scanBest)
+			{
+				scanBest = cost;
+			}
+
+			int errNo = 0;
+			start = NowSeconds();
+			ConfigReader *reader = ConfigReaderCreate(fileName, &errNo);
+			cost = NowSeconds() - start;
+			if (reader == NULL)
+			{
+				printf("config reader create failed, errNo[%d]\n", errNo);
+				break;
+			}
+			ConfigReaderDestory(reader);
+			if (round == 0 || cost < createBest)
+			{
+				createBest = cost;
+			}
+		}
+
+		printf("%s\t%.2f\t\t%.2f\t\t%zu\n", implNames[impl],
+			len / scanBest / 1e9, len / createBest / 1e9, sum);
+	}
+
+	unlink(fileName);
+	free(buf);
+	return 0;
+}
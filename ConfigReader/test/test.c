@@ -1,7 +1,455 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "config_reader.h"
+#include "config_reloader.h"
+#include "config_layers.h"
+#include "config_image.h"
+
+#define LONG_VALUE_LEN (300 * 1024)
+
+/*
+ * 每次最多返回step字节的内存数据流，模拟管道
+ */
+typedef struct MemStream
+{
+	const char *data;
+	size_t len;
+	size_t pos;
+	size_t step;
+}MemStream;
+
+static long MemStreamRead(void *ctx, char *buf, size_t len)
+{
+	MemStream *stream = (MemStream*)ctx;
+	size_t n = stream->len - stream->pos;
+	if (n > len) n = len;
+	if (n > stream->step) n = stream->step;
+	memcpy(buf, stream->data + stream->pos, n);
+	stream->pos += n;
+	return n;
+}
+
+static void TestTyped(const ConfigReader *reader)
+{
+	printf("\ntyped demo: \n");
+	int errNo = 0;
+	printf("server.port=%lld\n", (long long)ConfigReaderGetInt64(reader, "server", "port", 0, &errNo));
+	printf("server.ratio=%.2f\n", ConfigReaderGetDouble(reader, "server", "ratio", 0.0, &errNo));
+	printf("server.debug=%d\n", ConfigReaderGetBool(reader, "server", "debug", 0, &errNo));
+	printf("server.timeout=%lldms\n",
+		(long long)ConfigReaderGetDurationMs(reader, "server", "timeout", 0, &errNo));
+	printf("server.buffer=%lld bytes\n",
+		(long long)ConfigReaderGetSizeBytes(reader, "server", "buffer", 0, &errNo));
+
+	int count = 0;
+	const char* const* hosts = ConfigReaderGetList(reader, "server", "hosts", &count, &errNo);
+	int i = 0;
+	for (i = 0; i < count; ++i)
+	{
+		printf("server.hosts[%d]=%s\n", i, hosts[i]);
+	}
+
+	// 前导0按十进制解析，只有0x前缀按十六进制解析
+	printf("server.octal=%lld\n", (long long)ConfigReaderGetInt64(reader, "server", "octal", 0, &errNo));
+	printf("server.mask=%lld\n", (long long)ConfigReaderGetInt64(reader, "server", "mask", 0, &errNo));
+	long long ms = ConfigReaderGetDurationMs(reader, "server", "interval", -1, &errNo);
+	printf("server.interval=%lldms, errNo[%d]\n", ms, errNo);
+
+	long long n = ConfigReaderGetInt64(reader, "website", "baidu", -1, &errNo);
+	printf("website.baidu as int64=%lld, errNo[%d]\n", n, errNo);
+	n = ConfigReaderGetInt64(reader, "server", "none", -1, &errNo);
+	printf("server.none as int64=%lld, errNo[%d]\n", n, errNo);
+}
+
+static void WriteFile(const char *fileName, const char *text)
+{
+	// 先写临时文件再重命名，和常见的编辑器、发布工具一致
+	char tmpName[512] = {'\0'};
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+	FILE *fp = fopen(tmpName, "w");
+	if (fp == NULL)
+	{
+		return;
+	}
+	fputs(text, fp);
+	fclose(fp);
+	rename(tmpName, fileName);
+}
+
+static void RewriteFile(const char *fileName, const char *text)
+{
+	// 原地截短并改写，已有的文件映射会看到新的内容
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL)
+	{
+		return;
+	}
+	fputs(text, fp);
+	fclose(fp);
+}
+
+static void TestReload(const char *path)
+{
+	printf("\nreload demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%sreload.ini", path);
+	WriteFile(fileName, "[service]\nversion=1\n");
+
+	// 零拷贝要求文件不被改写，不能热加载
+	int errNo = 0;
+	ConfigReloader *reloader = ConfigReloaderCreate(fileName, CONFIG_READER_ZERO_COPY, &errNo);
+	printf("zero copy reloader: %s, errNo[%d]\n", reloader == NULL ? "NULL" : "reloader", errNo);
+	ConfigReloaderDestory(reloader);
+
+	reloader = ConfigReloaderCreate(fileName, 0, &errNo);
+	if (reloader == NULL)
+	{
+		printf("config reloader create failed, errNo[%d]\n", errNo);
+		unlink(fileName);
+		return;
+	}
+
+	int token = 0;
+	const ConfigReader *reader = ConfigReloaderAcquire(reloader, &token);
+	// value只在Release前有效，Release后后台线程随时可能销毁旧的配置
+	printf("service.version=%s\n", ConfigReaderGetValue(reader, "service", "version"));
+	ConfigReloaderRelease(reloader, token);
+
+	WriteFile(fileName, "[service]\nversion=2\n");
+	int i = 0;
+	for (i = 0; i < 300 && ConfigReloaderGetVersion(reloader) == 0; ++i)
+	{
+		usleep(10 * 1000);
+	}
+
+	reader = ConfigReloaderAcquire(reloader, &token);
+	printf("reloaded: %u, service.version=%s\n", ConfigReloaderGetVersion(reloader),
+		ConfigReaderGetValue(reader, "service", "version"));
+	ConfigReloaderRelease(reloader, token);
+
+	// 格式错误时保留旧的配置
+	WriteFile(fileName, "version=3\n");
+	for (i = 0; i < 300 && ConfigReloaderGetLastError(reloader) == 0; ++i)
+	{
+		usleep(10 * 1000);
+	}
+
+	reader = ConfigReloaderAcquire(reloader, &token);
+	printf("bad reload errNo[%d], service.version=%s\n", ConfigReloaderGetLastError(reloader),
+		ConfigReaderGetValue(reader, "service", "version"));
+	ConfigReloaderRelease(reloader, token);
+
+	ConfigReloaderDestory(reloader);
+	unlink(fileName);
+}
+
+static void TestImage(const ConfigReader *reader, const char *path)
+{
+	printf("\nimage demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%stest.img", path);
+	int errNo = ConfigReaderWriteImage(reader, fileName);
+	if (errNo != 0)
+	{
+		printf("write image failed, errNo[%d]\n", errNo);
+		return;
+	}
+
+	ConfigReader *image = ConfigReaderOpenImage(fileName, CONFIG_READER_VERIFY_IMAGE, &errNo);
+	if (image == NULL)
+	{
+		printf("open image failed, errNo[%d]\n", errNo);
+		unlink(fileName);
+		return;
+	}
+
+
+	printf("image sections=%d\n", ConfigReaderGetSectionCount(image));
+	printf("websize.baidu=%s\n", ConfigReaderGetValue(image, "website", "baidu"));
+	printf("ext.txt=%s\n", ConfigReaderGetValue(image, "ext", "txt"));
+	const ConfigKeyValue *port = ConfigReaderLookupHandle(image, "server", "port");
+	printf("server.port=%lld\n", (long long)ConfigHandleGetInt64(port, 0, &errNo));
+	printf("load server=%d, load none=%d\n", ConfigReaderLoadSection(image, "server"),
+		ConfigReaderLoadSection(image, "none"));
+	ConfigReaderDestory(image);
+
+	// 偏移加上表的大小溢出时同样是格式错误，镜像是共享映射，不能在映射期间修改
+	uint64_t offset = UINT64_MAX - 7;
+	int fd = open(fileName, O_WRONLY);
+	pwrite(fd, &offset, sizeof(offset), offsetof(ConfigImageHeader, sectionOffset));
+	close(fd);
+	image = ConfigReaderOpenImage(fileName, 0, &errNo);
+	printf("bad section offset: %s, errNo[%d]\n", image == NULL ? "NULL" : "reader", errNo);
+	ConfigReaderDestory(image);
+	unlink(fileName);
+}
+
+static void TestParallel(const char *path)
+{
+	printf("\nparallel demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%sparallel.ini", path);
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL)
+	{
+		return;
+	}
+	int i = 0;
+	for (i = 0; i < 20000; ++i)
+	{
+		if (i % 100 == 0)
+		{
+			fprintf(fp, "[section_%d]\n", i / 100);
+		}
+		fprintf(fp, "key_%d = value_%d # comment\n", (i * 13) % 1000, i);
+	}
+	fclose(fp);
+
+	int errNo = 0;
+	ConfigReader *serial = ConfigReaderCreate(fileName, &errNo);
+	ConfigReaderSetParallelism(4);
+	ConfigReader *parallel = ConfigReaderCreateEx(fileName, CONFIG_READER_PARALLEL, &errNo);
+	ConfigReaderSetParallelism(0);
+	unlink(fileName);
+	if (serial == NULL || parallel == NULL)
+	{
+		printf("config reader create failed, errNo[%d]\n", errNo);
+		ConfigReaderDestory(serial);
+		ConfigReaderDestory(parallel);
+		return;
+	}
+
+	int mismatch = 0;
+	for (i = 0; i < serial->sectionCount; ++i)
+	{
+		const ConfigSection *section = serial->sections + i;
+		const ConfigSection *other = parallel->sections + i;
+		mismatch += strcmp(section->name, other->name) != 0 || section->kvCount != other->kvCount;
+	}
+	printf("sections=%d/%d, mismatches=%d\n", serial->sectionCount, parallel->sectionCount, mismatch);
+	printf("section_1.key_391=%s\n", ConfigReaderGetValue(parallel, "section_1", "key_391"));
+	ConfigReaderDestory(serial);
+	ConfigReaderDestory(parallel);
+}
+
+static void TestLazy(const char *path)
+{
+	printf("\nlazy demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%slazy.ini", path);
+	WriteFile(fileName, "# lazy\n[db]\nhost = db1\n[broken]\nno equal sign\n[db]\nport = 3306\n");
+
+	int errNo = 0;
+	ConfigReader *reader = ConfigReaderCreateEx(fileName, CONFIG_READER_LAZY, &errNo);
+	if (reader == NULL)
+	{
+		printf("lazy config reader create failed, errNo[%d]\n", errNo);
+		unlink(fileName);
+		return;
+	}
+
+	// 创建后文件被原地截短，未解析的section仍使用创建时的内容
+	RewriteFile(fileName, "[x]\n");
+	unlink(fileName);
+
+	// 同名section合并，格式错误在section第一次访问时返回
+	printf("sections=%d\n", ConfigReaderGetSectionCount(reader));
+	printf("db.host=%s, db.port=%s\n", ConfigReaderGetValue(reader, "db", "host"),
+		ConfigReaderGetValue(reader, "db", "port"));
+	printf("load broken=%d, load db=%d\n", ConfigReaderLoadSection(reader, "broken"),
+		ConfigReaderLoadSection(reader, "db"));
+	ConfigReaderDestory(reader);
+}
+
+static void PrintChange(void *ctx, int change, const char *sectionName,
+	const char *key, const char *oldValue, const char *newValue)
+{
+	const char *names[] = {"", "added", "removed", "modified"};
+	printf("%s %s.%s: %s -> %s\n", names[change], sectionName, key,
+		oldValue != NULL ? oldValue : "(null)", newValue != NULL ? newValue : "(null)");
+}
+
+static void TestDiff(const char *path)
+{
+	printf("\ndiff demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%sdiff.ini", path);
+	WriteFile(fileName, "[db]\nhost = db1\nport = 3306\n[cache]\nsize = 64M\n[old]\nk = v\n");
+
+	int errNo = 0;
+	ConfigReader *old = ConfigReaderCreateDiff(fileName, 0, NULL, NULL, NULL, &errNo);
+	if (old == NULL)
+	{
+		printf("diff config reader create failed, errNo[%d]\n", errNo);
+		unlink(fileName);
+		return;
+	}
+	printf("cache.size=%s\n", ConfigReaderGetValue(old, "cache", "size"));
+
+	// cache未变化，与旧reader共享已解析的kv
+	WriteFile(fileName, "[db]\nhost = db2\nport = 3306\nuser = app\n[cache]\nsize = 64M\n[new]\nk = v\n");
+	ConfigReader *reader = ConfigReaderCreateDiff(fileName, 0, old, PrintChange, NULL, &errNo);
+	const char *shared = ConfigReaderGetValue(reader, "cache", "size");
+	printf("shared=%d\n", shared == ConfigReaderGetValue(old, "cache", "size"));
+	ConfigReaderDestory(old);
+	printf("cache.size=%s, db.host=%s\n", shared, ConfigReaderGetValue(reader, "db", "host"));
+
+	// 变化的section格式错误时不通知
+	WriteFile(fileName, "[db]\nhost\n[cache]\nsize = 64M\n");
+	old = ConfigReaderCreateDiff(fileName, 0, reader, PrintChange, NULL, &errNo);
+	printf("bad diff: %s, errNo[%d]\n", old == NULL ? "NULL" : "reader", errNo);
+	ConfigReaderDestory(reader);
+
+	// 原地改写同样能发现变化，旧reader的hash来自创建时读入的内容
+	// modified a.k: one -> two
+	WriteFile(fileName, "[a]\nk = one\n");
+	errNo = 0;
+	old = ConfigReaderCreateDiff(fileName, 0, NULL, NULL, NULL, &errNo);
+	printf("a.k=%s\n", ConfigReaderGetValue(old, "a", "k"));
+	RewriteFile(fileName, "[a]\nk = two\n");
+	reader = ConfigReaderCreateDiff(fileName, 0, old, PrintChange, NULL, &errNo);
+	printf("rewritten a.k=%s, errNo[%d]\n", ConfigReaderGetValue(reader, "a", "k"), errNo);
+	ConfigReaderDestory(old);
+	ConfigReaderDestory(reader);
+	unlink(fileName);
+}
+
+static void TestLazyReload(const char *path)
+{
+	printf("\nlazy reload demo: \n");
+	char fileName[512] = {'\0'};
+	snprintf(fileName, sizeof(fileName), "%slazy_reload.ini", path);
+	WriteFile(fileName, "[service]\nversion=1\n[db]\nhost=db1\n");
+
+	int errNo = 0;
+	ConfigReloader *reloader = ConfigReloaderCreate(fileName, CONFIG_READER_LAZY, &errNo);
+	if (reloader == NULL)
+	{
+		printf("config reloader create failed, errNo[%d]\n", errNo);
+		unlink(fileName);
+		return;
+	}
+	ConfigReloaderAddCallback(reloader, PrintChange, NULL);
+
+	// 原地改写触发IN_CLOSE_WRITE，旧配置中还未解析的db按创建时读入的内容比较
+	// removed db.host: db1 -> (null)
+	// modified service.version: 1 -> 2
+	RewriteFile(fileName, "[service]\nversion=2\n");
+	int i = 0;
+	for (i = 0; i < 300 && ConfigReloaderGetVersion(reloader) == 0; ++i)
+	{
+		usleep(10 * 1000);
+	}
+
+	int token = 0;
+	const ConfigReader *reader = ConfigReloaderAcquire(reloader, &token);
+	printf("reloaded: %u, service.version=%s\n", ConfigReloaderGetVersion(reloader),
+		ConfigReaderGetValue(reader, "service", "version"));
+	ConfigReloaderRelease(reloader, token);
+
+	ConfigReloaderDestory(reloader);
+	unlink(fileName);
+}
+
+static void TestLayers(const char *path)
+{
+	printf("\nlayers demo: \n");
+	char baseName[512] = {'\0'};
+	char hostName[512] = {'\0'};
+	snprintf(baseName, sizeof(baseName), "%sbase.ini", path);
+	snprintf(hostName, sizeof(hostName), "%shost.ini", path);
+	WriteFile(baseName, "[db]\nhost = base\nport = 3306\ntimeout = 1s\n[log]\nlevel = info\n");
+	WriteFile(hostName, "[db]\nhost = host1\ntimeout =\n");
+
+	int errNo = 0;
+	ConfigReader *base = ConfigReaderCreate(baseName, &errNo);
+	ConfigReader *host = ConfigReaderCreate(hostName, &errNo);
+	ConfigLayers *layers = ConfigLayersCreate(&errNo);
+	if (base == NULL || host == NULL || layers == NULL)
+	{
+		printf("layers create failed, errNo[%d]\n", errNo);
+		ConfigReaderDestory(base);
+		ConfigReaderDestory(host);
+		ConfigLayersDestory(layers);
+		unlink(baseName);
+		unlink(hostName);
+		return;
+	}
+	ConfigLayersPush(layers, base);
+	int hostLayer = ConfigLayersPush(layers, host);
+
+	// 上层的空value同样覆盖下层
+	int token = ConfigLayersAcquire(layers);
+	int layer = 0;
+	const ConfigKeyValue *handle = ConfigLayersLookupHandle(layers, "db", "timeout", &layer);
+	printf("db.host=%s, db.port=%s, db.timeout=%s from layer %d\n",
+		ConfigLayersGetValue(layers, "db", "host"), ConfigLayersGetValue(layers, "db", "port"),
+		ConfigHandleValue(handle), layer);
+	printf("db.port as int64=%lld, log.level=%s\n",
+		(long long)ConfigLayersGetInt64(layers, "db", "port", 0, &errNo),
+		ConfigLayersGetValue(layers, "log", "level"));
+	ConfigLayersRelease(layers, token);
+
+	// 只重新加载主机层，Replace返回时已没有读取方使用旧的主机层
+	WriteFile(hostName, "[log]\nlevel = debug\n");
+	ConfigReader *newHost = ConfigReaderCreate(hostName, &errNo);
+	if (newHost != NULL)
+	{
+		ConfigReaderDestory((ConfigReader*)ConfigLayersReplace(layers, hostLayer, newHost));
+		host = newHost;
+	}
+	token = ConfigLayersAcquire(layers);
+	printf("replaced: db.host=%s, log.level=%s\n", ConfigLayersGetValue(layers, "db", "host"),
+		ConfigLayersGetValue(layers, "log", "level"));
+	ConfigLayersRelease(layers, token);
+
+	ConfigLayersDestory(layers);
+	ConfigReaderDestory(host);
+	ConfigReaderDestory(base);
+	unlink(baseName);
+	unlink(hostName);
+}
+
+static void TestStream(const char *configFile)
+{
+	printf("\nstream demo: \n");
+	int errNo = 0;
+	int fd = open(configFile, O_RDONLY);
+	ConfigReader *reader = ConfigReaderCreateFromFd(fd, &errNo);
+	close(fd);
+	if (reader == NULL)
+	{
+		printf("fd config reader create failed, errNo[%d]\n", errNo);
+		return;
+	}
+	printf("fd network.protocol=%s\n", ConfigReaderGetValue(reader, "network", "protocol"));
+	ConfigReaderDestory(reader);
+
+	// 超过流缓冲区的长行
+	char *text = (char*)malloc(LONG_VALUE_LEN + 64);
+	int len = sprintf(text, "[pem]\ncert = ");
+	memset(text + len, 'A', LONG_VALUE_LEN);
+	len += LONG_VALUE_LEN;
+	len += sprintf(text + len, "\nnext = ok");
+
+	MemStream stream = {text, len, 0, 4093};
+	reader = ConfigReaderCreateFromCallback(MemStreamRead, &stream, &errNo);
+	if (reader == NULL)
+	{
+		printf("callback config reader create failed, errNo[%d]\n", errNo);
+		free(text);
+		return;
+	}
+	printf("pem.cert length=%d\n", (int)strlen(ConfigReaderGetValue(reader, "pem", "cert")));
+	printf("pem.next=%s\n", ConfigReaderGetValue(reader, "pem", "next"));
+	ConfigReaderDestory(reader);
+	free(text);
+}
 
 int main(int argc, char *argv[])
 {
@@ -28,7 +476,40 @@ int main(int argc, char *argv[])
 	printf("ext.py=%s\n", ConfigReaderGetValue(reader, "ext", "py"));
 	printf("ext.txt=%s\n", ConfigReaderGetValue(reader, "ext", "txt"));
 
+	printf("\nhandle demo: \n");
+	const ConfigKeyValue *protocol = ConfigReaderLookupHandle(reader, "network", "protocol");
+	const ConfigKeyValue *missing = ConfigReaderLookupHandle(reader, "network", "none");
+	printf("network.protocol=%s, missing: %d\n", ConfigHandleValue(protocol),
+		ConfigHandleIsMissing(protocol));
+	printf("network.none=%s, missing: %d\n", ConfigHandleValue(missing),
+		ConfigHandleIsMissing(missing));
+
+	TestTyped(reader);
+	TestImage(reader, path);
+
+	ConfigReaderDestory(reader);
+
+	printf("\nzero copy demo: \n");
+	reader = ConfigReaderCreateEx(configFile, CONFIG_READER_ZERO_COPY, &errNo);
+	if (reader == NULL)
+	{
+		printf("zero copy config reader create failed, errNo[%d]\n", errNo);
+		return 0;
+	}
+
+	const char *baidu = ConfigReaderGetValue(reader, "website", "baidu");
+	printf("websize.baidu=%s, in mapped file: %s\n", baidu,
+		baidu >= reader->source && baidu < reader->source + reader->sourceLen ? "yes" : "no");
+	printf("ext.txt=%s\n", ConfigReaderGetValue(reader, "ext", "txt"));
 	ConfigReaderDestory(reader);
+
+	TestStream(configFile);
+	TestReload(path);
+	TestParallel(path);
+	TestLazy(path);
+	TestDiff(path);
+	TestLazyReload(path);
+	TestLayers(path);
 	return 0;
 
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_reader.h"
+
+/*
+ * 把ini配置编译为ConfigReaderOpenImage使用的二进制镜像
+ * 用法: config_compile input.ini output.img
+ * 编译后重新打开镜像并校验checksum，逐项比较所有value
+ */
+
+static int CompareImage(const ConfigReader *reader, const ConfigReader *image)
+{
+	int diff = 0;
+	int i = 0;
+	for (i = 0; i < reader->sectionCount; ++i)
+	{
+		const ConfigSection *section = reader->sections + i;
+		int j = 0;
+		for (j = 0; j < section->kvCount; ++j)
+		{
+			const char *key = section->kvs[j].key;
+			if (strcmp(ConfigReaderGetValue(reader, section->name, key),
+				ConfigReaderGetValue(image, section->name, key)) != 0)
+			{
+				printf("value mismatch: [%s] %s\n", section->name, key);
+				++diff;
+			}
+		}
+	}
+	return diff;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		printf("usage: %s input.ini output.img\n", argv[0]);
+		return 1;
+	}
+
+	int errNo = 0;
+	ConfigReader *reader = ConfigReaderCreate(argv[1], &errNo);
+	if (reader == NULL)
+	{
+		printf("config reader create failed, errNo[%d]\n", errNo);
+		return 1;
+	}
+
+	errNo = ConfigReaderWriteImage(reader, argv[2]);
+	if (errNo != 0)
+	{
+		printf("write image failed, errNo[%d]\n", errNo);
+		ConfigReaderDestory(reader);
+		return 1;
+	}
+
+	ConfigReader *image = ConfigReaderOpenImage(argv[2], CONFIG_READER_VERIFY_IMAGE, &errNo);
+	if (image == NULL)
+	{
+		printf("open image failed, errNo[%d]\n", errNo);
+		ConfigReaderDestory(reader);
+		return 1;
+	}
+
+	int diff = CompareImage(reader, image);
+	printf("%s: %d sections, %lu bytes, %d mismatches\n", argv[2],
+		ConfigReaderGetSectionCount(image), (unsigned long)image->sourceLen, diff);
+
+	ConfigReaderDestory(image);
+	ConfigReaderDestory(reader);
+	return diff == 0 ? 0 : 1;
+}
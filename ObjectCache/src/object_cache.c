@@ -2,32 +2,104 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #include "object_cache.h"
+#include "object_spill.h"
+#include "object_trace.h"
 
 #define MAX_INT 0x7FFFFFFF
+#define FRONT_CACHE_SIZE 1024		// 每个线程的前端缓存槽数，必须是2的幂
+#define FRONT_CACHE_KEY_LEN 48		// 只有长度小于该值的key才进入前端缓存
+#define FRONT_CACHE_MAX_STALE 1		// 前端缓存命中的最长有效时间(秒)，超过后回到共享表刷新访问统计
+#define FRONT_CACHE_STRIPES 4096	// 按key的hash分条带记录版本号，必须是2的幂
+#define TYPE_GEN_SLOTS 256			// 记录typeID版本号的槽数，必须是2的幂
+#define RECLAIM_STEP 4				// 有失效数据待回收时，每次Insert顺带清理的桶数
+
+#define ENTRY_CLEAN 0		// 数据已写入后端存储
+#define ENTRY_DIRTY 1		// 数据未写入后端存储，在dirty链表中
+#define ENTRY_FLUSHING 2	// 数据正在由后台线程写入后端存储
+#define FLUSH_IDLE_MS 100	// 没有dirty数据时后台写出线程的等待时间(毫秒)
+#define ERR_FLUSH_BUSY -1	// 后台线程正在写出，等它写完后重试，只在内部使用
 
 typedef struct CacheEntry
 {
 	char *key;
+	unsigned int hash;
 	void *obj;
 	int typeID;
 	unsigned int visitCnt;
 	time_t expireStamps;
 	time_t visitStamps;
+	uint64_t generation;	// 插入时的版本号，高32位为全局版本号，低32位为typeID的版本号
+	int dirty;				// ENTRY_*
+	uint64_t dirtyMs;		// 变为dirty的时间(毫秒)
+	struct CacheEntry *dirtyPrev;
+	struct CacheEntry *dirtyNext;
 	struct CacheEntry *next;
 }CacheEntry;
 
+typedef struct TypeGeneration
+{
+	int typeID;
+	unsigned int generation;
+	int used;
+}TypeGeneration;
+
 typedef struct ObjectCacheMng
 {
 	CacheEntry **table;
 	unsigned int sizeMask;
 	unsigned int keyCnt;
 	unsigned int maxKeyCnt;
+	unsigned int defaultExpireTime;	// ObjectCacheInsert的expireTime为0时使用的过期时间
 	DumpFunc dump;
 	ReleaseFunc release;
+	SpillStore *spill;	// 二级缓存，未开启时为NULL
+	int frontCache;		// 是否开启线程本地的前端缓存
+	unsigned int epoch;	// 清空或按类型失效时递增，所有线程的前端缓存随即失效
+	unsigned int versions[FRONT_CACHE_STRIPES];	// 删除或修改entry时递增key所在条带的版本号
+	ClockFunc clock;
+	ObjectTrace *trace;	// 访问记录，未开启时为NULL
+	unsigned int traceSampleRate;	// 访问记录的采样率，未开启时为0，前端缓存命中时不加锁读取
+	SizeFunc size;
+	unsigned int generation;	// 全局版本号，递增后所有entry失效
+	unsigned int typeGenCnt;
+	TypeGeneration typeGens[TYPE_GEN_SLOTS];
+	unsigned int reclaimCursor;		// 下一个待清理的桶
+	unsigned int reclaimPending;	// 失效后还需清理的桶数
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	FlushFunc flush;			// 后端存储的写入函数，未开启write-behind时为NULL
+	unsigned int batchSize;
+	unsigned int maxDelayMs;
+	CacheEntry *dirtyHead;		// dirty链表，按变为dirty的时间排序
+	CacheEntry *dirtyTail;
+	unsigned int dirtyCnt;
+	pthread_t flusher;
+	int stopping;
+	int flushing;				// 后台线程正在不持有锁调用flush，此时其他路径不能调用flush
+	pthread_cond_t flushCond;	// 后台线程写完一批后广播
+	unsigned int lostCnt;		// ObjectCacheDestory时写出失败而丢弃的dirty对象数
 }ObjectCacheMng;
 
+typedef struct FrontSlot
+{
+	unsigned int hash;
+	unsigned int epoch;
+	unsigned int version;
+	int typeID;
+	time_t expireStamps;
+	time_t fillStamps;
+	void *obj;
+	char key[FRONT_CACHE_KEY_LEN];
+}FrontSlot;
+
+static __thread FrontSlot *tlsFrontSlots = NULL;
+static pthread_key_t frontSlotsKey;
+static pthread_once_t frontSlotsOnce = PTHREAD_ONCE_INIT;
+
 static unsigned int GenHashValue(const void *key, int len) 
 {
     /* 'm' and 'r' are mixing constants generated offline.
@@ -96,14 +168,293 @@ static ObjectCacheMng* ObjectCacheMngInstance()
 		.sizeMask = 0,
 		.keyCnt = 0,
 		.maxKeyCnt = 0,
+		.defaultExpireTime = 0,
 		.dump = NULL,
-		.release = NULL
+		.release = NULL,
+		.spill = NULL,
+		.frontCache = 0,
+		.epoch = 0,
+		.clock = time,
+		.trace = NULL,
+		.traceSampleRate = 0,
+		.size = NULL,
+		.generation = 0,
+		.typeGenCnt = 0,
+		.reclaimCursor = 0,
+		.reclaimPending = 0,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.flush = NULL,
+		.batchSize = 0,
+		.maxDelayMs = 0,
+		.dirtyHead = NULL,
+		.dirtyTail = NULL,
+		.dirtyCnt = 0,
+		.stopping = 0,
+		.flushing = 0,
+		.flushCond = PTHREAD_COND_INITIALIZER,
+		.lostCnt = 0
 	};
 	return &mng;
 }
 
-static CacheEntry* CacheEntryCreate(const char *key, const void *obj, int typeID, 
-	unsigned int expireTime, DumpFunc dump)
+static void ObjectCacheMngBumpEpoch(ObjectCacheMng *mng)
+{
+	__atomic_add_fetch(&mng->epoch, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * entry被删除或修改时只使同一条带中的前端缓存失效，淘汰其他key不影响已缓存的热点key
+ */
+static void ObjectCacheMngBumpVersion(ObjectCacheMng *mng, const CacheEntry *entry)
+{
+	if (mng->frontCache)
+	{
+		__atomic_add_fetch(&mng->versions[entry->hash & (FRONT_CACHE_STRIPES - 1)], 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void FrontSlotsFree(void *slots)
+{
+	free(slots);
+}
+
+static void FrontSlotsKeyCreate()
+{
+	pthread_key_create(&frontSlotsKey, FrontSlotsFree);
+}
+
+static FrontSlot* FrontSlotsInstance()
+{
+	if (tlsFrontSlots == NULL)
+	{
+		pthread_once(&frontSlotsOnce, FrontSlotsKeyCreate);
+		tlsFrontSlots = (FrontSlot*)calloc(FRONT_CACHE_SIZE, sizeof(FrontSlot));
+		if (tlsFrontSlots != NULL)
+		{
+			// 线程退出时释放
+			pthread_setspecific(frontSlotsKey, tlsFrontSlots);
+		}
+	}
+	return tlsFrontSlots;
+}
+
+/*
+ * 在当前线程的前端缓存中查找key，命中时不访问共享表，
+ * 只读取很少写入的全局版本号和key所在条带的版本号
+ */
+static void* FrontCacheGet(const ObjectCacheMng *mng, const char *key, unsigned int hash,
+	time_t now, int *typeID)
+{
+	FrontSlot *slots = FrontSlotsInstance();
+	if (slots == NULL)
+	{
+		return NULL;
+	}
+
+	FrontSlot *slot = slots + (hash & (FRONT_CACHE_SIZE - 1));
+	if (slot->obj == NULL || slot->hash != hash ||
+		slot->epoch != __atomic_load_n(&mng->epoch, __ATOMIC_ACQUIRE) ||
+		slot->version != __atomic_load_n(&mng->versions[hash & (FRONT_CACHE_STRIPES - 1)], __ATOMIC_ACQUIRE) ||
+		slot->expireStamps <= now || slot->fillStamps + FRONT_CACHE_MAX_STALE < now ||
+		strcmp(slot->key, key) != 0)
+	{
+		return NULL;
+	}
+
+	*typeID = slot->typeID;
+	return slot->obj;
+}
+
+static void FrontCacheFill(const ObjectCacheMng *mng, const CacheEntry *entry,
+	unsigned int keyLen, unsigned int hash, time_t now)
+{
+	if (keyLen >= FRONT_CACHE_KEY_LEN)
+	{
+		return;
+	}
+
+	FrontSlot *slots = FrontSlotsInstance();
+	if (slots == NULL)
+	{
+		return;
+	}
+
+	FrontSlot *slot = slots + (hash & (FRONT_CACHE_SIZE - 1));
+	slot->hash = hash;
+	slot->epoch = __atomic_load_n(&mng->epoch, __ATOMIC_ACQUIRE);
+	slot->version = __atomic_load_n(&mng->versions[hash & (FRONT_CACHE_STRIPES - 1)], __ATOMIC_ACQUIRE);
+	slot->typeID = entry->typeID;
+	slot->expireStamps = entry->expireStamps;
+	slot->fillStamps = now;
+	slot->obj = entry->obj;
+	memcpy(slot->key, entry->key, keyLen + 1);
+}
+
+static uint64_t NowMs()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void ObjectCacheMngMarkDirty(ObjectCacheMng *mng, CacheEntry *entry)
+{
+	if (entry->dirty == ENTRY_DIRTY)
+	{
+		// 已在dirty链表中，写入时使用最新的数据
+		return;
+	}
+
+	entry->dirty = ENTRY_DIRTY;
+	entry->dirtyMs = NowMs();
+	entry->dirtyNext = NULL;
+	entry->dirtyPrev = mng->dirtyTail;
+	if (mng->dirtyTail != NULL)
+	{
+		mng->dirtyTail->dirtyNext = entry;
+	}
+	else
+	{
+		mng->dirtyHead = entry;
+	}
+	mng->dirtyTail = entry;
+
+	if (++mng->dirtyCnt == mng->batchSize)
+	{
+		pthread_cond_signal(&mng->cond);
+	}
+}
+
+static void ObjectCacheMngUnlinkDirty(ObjectCacheMng *mng, CacheEntry *entry)
+{
+	if (entry->dirtyPrev != NULL)
+	{
+		entry->dirtyPrev->dirtyNext = entry->dirtyNext;
+	}
+	else
+	{
+		mng->dirtyHead = entry->dirtyNext;
+	}
+
+	if (entry->dirtyNext != NULL)
+	{
+		entry->dirtyNext->dirtyPrev = entry->dirtyPrev;
+	}
+	else
+	{
+		mng->dirtyTail = entry->dirtyPrev;
+	}
+
+	entry->dirtyPrev = NULL;
+	entry->dirtyNext = NULL;
+	--mng->dirtyCnt;
+}
+
+/*
+ * 在持有锁的情况下同步写出一个dirty的entry
+ * 后台线程正在写出时返回ERR_FLUSH_BUSY，保证flush不会被并发调用，
+ * 同一个key较新的数据也不会被较旧的一批覆盖
+ */
+static int ObjectCacheMngFlushEntry(ObjectCacheMng *mng, CacheEntry *entry)
+{
+	if (mng->flushing)
+	{
+		return ERR_FLUSH_BUSY;
+	}
+
+	const char *keys[1] = {entry->key};
+	void *objs[1] = {entry->obj};
+	int typeIDs[1] = {entry->typeID};
+	if (mng->flush(keys, objs, typeIDs, 1) != 0)
+	{
+		return ERR_FLUSH_FAILED;
+	}
+
+	ObjectCacheMngUnlinkDirty(mng, entry);
+	entry->dirty = ENTRY_CLEAN;
+	return 0;
+}
+
+/*
+ * 等待后台线程写完正在写出的一批，之后只要一直持有锁就不会有并发的flush
+ * 等待期间会释放锁，返回后需要重新检查缓存是否已被销毁
+ */
+static void ObjectCacheMngWaitFlushing(ObjectCacheMng *mng)
+{
+	while (mng->flushing)
+	{
+		pthread_cond_wait(&mng->flushCond, &mng->lock);
+	}
+}
+
+static TypeGeneration* ObjectCacheMngFindTypeGen(ObjectCacheMng *mng, int typeID, int create)
+{
+	unsigned int i = (unsigned int)typeID & (TYPE_GEN_SLOTS - 1);
+	unsigned int n = 0;
+	for (n = 0; n < TYPE_GEN_SLOTS; ++n)
+	{
+		TypeGeneration *typeGen = mng->typeGens + i;
+		if (!typeGen->used)
+		{
+			if (!create)
+			{
+				return NULL;
+			}
+
+			typeGen->typeID = typeID;
+			typeGen->generation = 0;
+			typeGen->used = 1;
+			++mng->typeGenCnt;
+			return typeGen;
+		}
+
+		if (typeGen->typeID == typeID)
+		{
+			return typeGen;
+		}
+		i = (i + 1) & (TYPE_GEN_SLOTS - 1);
+	}
+	return NULL;
+}
+
+/*
+ * typeID当前的版本号，entry记录的版本号与之不同时视为已失效
+ */
+static uint64_t ObjectCacheMngGeneration(ObjectCacheMng *mng, int typeID)
+{
+	uint64_t generation = (uint64_t)mng->generation << 32;
+	if (mng->typeGenCnt > 0)
+	{
+		TypeGeneration *typeGen = ObjectCacheMngFindTypeGen(mng, typeID, 0);
+		if (typeGen != NULL)
+		{
+			generation |= typeGen->generation;
+		}
+	}
+	return generation;
+}
+
+static int ObjectCacheMngIsStale(ObjectCacheMng *mng, const CacheEntry *entry)
+{
+	return entry->generation != ObjectCacheMngGeneration(mng, entry->typeID);
+}
+
+static void ObjectCacheMngTrace(ObjectCacheMng *mng, unsigned int hash, int op,
+	unsigned int keyLen, const void *obj, int typeID, unsigned int expireTime)
+{
+	if (ObjectTraceSampled(mng->traceSampleRate, hash))
+	{
+		unsigned int size = keyLen;
+		if (mng->size != NULL && obj != NULL)
+		{
+			size += mng->size(obj, typeID);
+		}
+		ObjectTraceAppend(mng->trace, hash, op, size, expireTime);
+	}
+}
+
+static CacheEntry* CacheEntryAlloc(const char *key, int typeID, time_t expireStamps, time_t now)
 {
 	CacheEntry *entry = (CacheEntry*)malloc(sizeof(CacheEntry));
 	if (entry == NULL)
@@ -120,6 +471,30 @@ static CacheEntry* CacheEntryCreate(const char *key, const void *obj, int typeID
 	}
 	memcpy(entry->key, key, len + 1);
 
+	entry->hash = GenHashValue(key, len);
+	entry->obj = NULL;
+	entry->typeID = typeID;
+	entry->visitCnt = 1;
+	entry->expireStamps = expireStamps;
+	entry->visitStamps = now;
+	entry->generation = 0;
+	entry->dirty = ENTRY_CLEAN;
+	entry->dirtyMs = 0;
+	entry->dirtyPrev = NULL;
+	entry->dirtyNext = NULL;
+	entry->next = NULL;
+	return entry;
+}
+
+static CacheEntry* CacheEntryCreate(const char *key, const void *obj, int typeID, 
+	unsigned int expireTime, time_t now, DumpFunc dump)
+{
+	CacheEntry *entry = CacheEntryAlloc(key, typeID, now + expireTime, now);
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+
 	entry->obj = dump(obj, typeID);
 	if (entry->obj == NULL)
 	{
@@ -127,13 +502,6 @@ static CacheEntry* CacheEntryCreate(const char *key, const void *obj, int typeID
 		free(entry);
 		return NULL;
 	}
-
-	time_t now = time(NULL);
-	entry->typeID = typeID;
-	entry->visitCnt = 1;
-	entry->expireStamps = now + expireTime;
-	entry->visitStamps = now;
-	entry->next = NULL;
 	return entry;
 }
 
@@ -153,7 +521,7 @@ static void CacheEntryDestory(CacheEntry *entry, ReleaseFunc release)
 }
 
 static int CacheEntrySet(CacheEntry *entry, const void *obj, int typeID, unsigned int expireTime,
-	DumpFunc dump, ReleaseFunc release)
+	time_t now, DumpFunc dump, ReleaseFunc release)
 {
 	void *newObj = dump(obj, entry->typeID);
 	if (newObj == NULL)
@@ -167,7 +535,7 @@ static int CacheEntrySet(CacheEntry *entry, const void *obj, int typeID, unsigne
 	}
 
 	entry->obj = newObj;
-	entry->expireStamps = time(NULL) + expireTime;
+	entry->expireStamps = now + expireTime;
 	return 0;
 }
 
@@ -195,12 +563,25 @@ static int ObjectCacheMngFindEntry(const ObjectCacheMng *mng, unsigned int index
 	return -1;
 }
 
-static void ObjectCacheMngRemoveEntry(ObjectCacheMng *mng, unsigned int i, 
+/*
+ * @return 0成功，dirty的entry写出失败时保留该entry，返回ERR_FLUSH_FAILED或ERR_FLUSH_BUSY
+ */
+static int ObjectCacheMngRemoveEntry(ObjectCacheMng *mng, unsigned int i, 
 	CacheEntry *preEntry, CacheEntry *entry)
 {
 	if (entry == NULL || preEntry == NULL)
 	{
-		return;
+		return ERR_PARAM_INVALID;
+	}
+
+	if (entry->dirty != ENTRY_CLEAN)
+	{
+		// 未写入后端存储的数据先写出
+		int ret = ObjectCacheMngFlushEntry(mng, entry);
+		if (ret != 0)
+		{
+			return ret;
+		}
 	}
 
 	if (entry == preEntry)
@@ -213,13 +594,21 @@ static void ObjectCacheMngRemoveEntry(ObjectCacheMng *mng, unsigned int i,
 		// 删除的不是第一个entry
 		preEntry->next = entry->next;
 	}
+
+	ObjectCacheMngBumpVersion(mng, entry);
 	CacheEntryDestory(entry, mng->release);
 	--mng->keyCnt;
+	return 0;
 }
 
-static void ObjectCacheMngDieOut(ObjectCacheMng *mng)
+/*
+ * 淘汰一个entry，dirty的entry写出失败时不淘汰
+ * @return 0成功，没有可以淘汰的entry时返回ERR_FLUSH_FAILED或ERR_FLUSH_BUSY
+ */
+static int ObjectCacheMngDieOut(ObjectCacheMng *mng)
 {
-	time_t now = time(NULL);
+	time_t now = mng->clock(NULL);
+	int ret = ERR_FLUSH_FAILED;
 
 	CacheEntry *entry = NULL;
 	CacheEntry *preEntry = NULL;
@@ -228,25 +617,30 @@ static void ObjectCacheMngDieOut(ObjectCacheMng *mng)
 	unsigned int nruIndex = 0;
 
 	unsigned int i = 0;
-	for (i = 0; i < mng->sizeMask; ++i)
+	for (i = 0; i <= mng->sizeMask; ++i)
 	{
 		entry = mng->table[i];
 		preEntry = entry;
 
 		while(entry != NULL)
 		{
-			if (entry->expireStamps < now)
+			if (entry->expireStamps < now || ObjectCacheMngIsStale(mng, entry))
 			{
-				// 数据过期，删除过期的项
-				ObjectCacheMngRemoveEntry(mng, i, preEntry, entry);
-				return;
+				// 数据过期或已失效，删除该项，写出失败时继续查找
+				ret = ObjectCacheMngRemoveEntry(mng, i, preEntry, entry);
+				if (ret == 0)
+				{
+					return 0;
+				}
 			}
 			else
 			{
-				// 数据未过期, 记录最近未使用的项
+				// 数据未过期, 记录最近未使用的项，优先淘汰已写入后端存储的项
 				if (nruEntry == NULL || 
-					nruEntry->visitStamps > entry->visitStamps ||
-					(nruEntry->visitStamps == entry->visitStamps && nruEntry->visitCnt > entry->visitCnt))
+					(nruEntry->dirty != ENTRY_CLEAN && entry->dirty == ENTRY_CLEAN) ||
+					((nruEntry->dirty == ENTRY_CLEAN) == (entry->dirty == ENTRY_CLEAN) &&
+					(nruEntry->visitStamps > entry->visitStamps ||
+					(nruEntry->visitStamps == entry->visitStamps && nruEntry->visitCnt > entry->visitCnt))))
 				{
 					nruIndex = i;
 					nruEntry = entry;
@@ -258,171 +652,987 @@ static void ObjectCacheMngDieOut(ObjectCacheMng *mng)
 		} // end while
 	}
 
-	ObjectCacheMngRemoveEntry(mng, nruIndex, preNruUseEntry, nruEntry);
-}
-
-static int ObjectCacheMngInsert(ObjectCacheMng *mng, unsigned int index, 
-	const char *key, const void *obj, int typeID, unsigned int expireTime)
-{
-	CacheEntry *entry = CacheEntryCreate(key, obj, typeID, expireTime, mng->dump);
-	if (entry == NULL)
-	{
-		return ERR_OUT_OF_MEM;
-	}
-
-	if (mng->keyCnt >= mng->maxKeyCnt)
+	if (nruEntry == NULL)
 	{
-		ObjectCacheMngDieOut(mng);
+		return ret;
 	}
 
-	entry->next = mng->table[index];
-	mng->table[index] = entry;
-	++mng->keyCnt;
-	return 0;
-}
-
-int ObjectCacheInit(unsigned int maxKeyCnt, DumpFunc dump, ReleaseFunc release)
-{
-	if (maxKeyCnt == 0 || dump == NULL || release == NULL)
+	if (nruEntry->dirty != ENTRY_CLEAN)
 	{
-		return ERR_PARAM_INVALID;
+		// 写出失败，暂不淘汰
+		ret = ObjectCacheMngFlushEntry(mng, nruEntry);
+		if (ret != 0)
+		{
+			return ret;
+		}
 	}
 
-	ObjectCacheMng *mng = ObjectCacheMngInstance();
-	if (mng->table)
+	if (mng->spill != NULL)
 	{
-		return ERR_REINIT;
+		// 淘汰的项写入二级缓存
+		SpillStorePut(mng->spill, nruEntry->key, nruEntry->hash,
+			nruEntry->obj, nruEntry->typeID, nruEntry->expireStamps, nruEntry->generation);
 	}
+	return ObjectCacheMngRemoveEntry(mng, nruIndex, preNruUseEntry, nruEntry);
+}
 
-	unsigned int sizeMask = GenSizeMask(maxKeyCnt);
-	CacheEntry **table = (CacheEntry**)malloc(sizeof(CacheEntry*) * sizeMask);
-	if (table == NULL)
+/*
+ * 缓存已满时淘汰entry，保证插入后不超过maxKeyCnt
+ * @return 0成功，dirty的entry都写出失败时返回ERR_FLUSH_FAILED或ERR_FLUSH_BUSY
+ */
+static int ObjectCacheMngMakeRoom(ObjectCacheMng *mng)
+{
+	while (mng->keyCnt >= mng->maxKeyCnt)
 	{
-		return ERR_OUT_OF_MEM;
+		int ret = ObjectCacheMngDieOut(mng);
+		if (ret != 0)
+		{
+			return ret;
+		}
 	}
-
-	memset(table, 0, sizeof(CacheEntry*) * sizeMask);
-	mng->table = table;
-	mng->sizeMask = sizeMask;
-	mng->keyCnt = 0;
-	mng->maxKeyCnt = maxKeyCnt;
-	mng->dump = dump;
-	mng->release = release;
 	return 0;
 }
 
-void ObjectCacheClear()
+static void ObjectCacheMngLinkEntry(ObjectCacheMng *mng, unsigned int index, CacheEntry *entry)
 {
-	ObjectCacheMng *mng = ObjectCacheMngInstance();
-	if (mng->table == NULL)
-	{
-		return;
-	}
+	entry->generation = ObjectCacheMngGeneration(mng, entry->typeID);
+	entry->next = mng->table[index];
+	mng->table[index] = entry;
+	++mng->keyCnt;
+}
 
-	unsigned int i = 0;
-	for (i = 0; i < mng->sizeMask; ++i)
+/*
+ * 从reclaimCursor开始清理bucketCnt个桶中过期或已失效的entry
+ * @return 删除的entry数
+ */
+static unsigned int ObjectCacheMngReclaim(ObjectCacheMng *mng, unsigned int bucketCnt, time_t now)
+{
+	unsigned int removed = 0;
+	for (; bucketCnt > 0; --bucketCnt)
 	{
-		if (mng->table[i] == NULL)
+		unsigned int i = mng->reclaimCursor;
+		mng->reclaimCursor = (i + 1) & mng->sizeMask;
+
+		CacheEntry *entry = mng->table[i];
+		CacheEntry *preEntry = entry;
+		while (entry != NULL)
 		{
-			continue;
+			CacheEntry *next = entry->next;
+			// dirty的entry写出失败时保留，之后再回收
+			if ((entry->expireStamps <= now || ObjectCacheMngIsStale(mng, entry)) &&
+				ObjectCacheMngRemoveEntry(mng, i, preEntry, entry) == 0)
+			{
+				++removed;
+				if (preEntry == entry)
+				{
+					// 删除的是第一个entry
+					preEntry = next;
+				}
+			}
+			else
+			{
+				preEntry = entry;
+			}
+			entry = next;
 		}
 
-		CacheEntry *entry1 = mng->table[i];
-		CacheEntry *entry2 = entry1;
-		while (entry1 != NULL)
+		if (mng->reclaimPending > 0)
 		{
-			entry2 = entry1->next;
-			CacheEntryDestory(entry1, mng->release);
-			entry1 = entry2;
+			--mng->reclaimPending;
 		}
-		mng->table[i] = NULL;
 	}
+	return removed;
+}
 
-	mng->keyCnt = 0;
+static void ObjectCacheMngInvalidated(ObjectCacheMng *mng)
+{
+	// 前端缓存随即失效，共享表中的entry在之后的Insert中分批回收
+	ObjectCacheMngBumpEpoch(mng);
+	mng->reclaimPending = mng->sizeMask + 1;
 }
 
-void ObjectCacheDestory()
+static int ObjectCacheMngInsert(ObjectCacheMng *mng, unsigned int index, 
+	const char *key, const void *obj, int typeID, unsigned int expireTime, time_t now)
 {
-	ObjectCacheMng *mng = ObjectCacheMngInstance();
-	if (mng->table == NULL)
+	CacheEntry *entry = CacheEntryCreate(key, obj, typeID, expireTime, now, mng->dump);
+	if (entry == NULL)
 	{
-		return;
+		return ERR_OUT_OF_MEM;
 	}
 
-	ObjectCacheClear();
-	free(mng->table);
-	mng->table = NULL;
-	mng->sizeMask = 0;
-	mng->maxKeyCnt = 0;
-	mng->dump = NULL;
-	mng->release = NULL;
+	ObjectCacheMngLinkEntry(mng, index, entry);
+	return 0;
 }
 
-void* ObjectCacheGet(const char *key)
+/*
+ * 从二级缓存中取出key对应的对象，并放回内存中
+ */
+static CacheEntry* ObjectCacheMngPromote(ObjectCacheMng *mng, unsigned int index,
+	const char *key, unsigned int hash, time_t now)
 {
-	if (key == NULL)
+	if (!SpillStoreContains(mng->spill, key, hash, now))
 	{
+		// 先查L2再腾位置，否则每次未命中都会把一个有效对象挤到L2
 		return NULL;
 	}
 
-	ObjectCacheMng *mng = ObjectCacheMngInstance();
-	if (mng->table == NULL)
+	if (ObjectCacheMngMakeRoom(mng) != 0)
 	{
+		// 内存中腾不出位置，对象留在L2中
 		return NULL;
 	}
 
-	unsigned int index = GenHashValue(key, strlen(key)) & mng->sizeMask;
-	CacheEntry *entry = NULL;
-	CacheEntry *preEntry = NULL;
-	int ret = ObjectCacheMngFindEntry(mng, index, key, &preEntry, &entry);
-	if (ret != 0)
+	int typeID = 0;
+	time_t expireStamps = 0;
+	uint64_t generation = 0;
+	void *obj = SpillStoreTake(mng->spill, key, hash, now, &typeID, &expireStamps, &generation);
+	if (obj == NULL)
 	{
 		return NULL;
 	}
 
-	time_t now = time(NULL);
-	if (entry->expireStamps > now)
+	if (generation != ObjectCacheMngGeneration(mng, typeID))
 	{
-		// key 没有过期
-		++entry->visitCnt;
-		entry->visitStamps = now;
-		return entry->obj;
+		// 写入L2后已失效
+		mng->release(obj, typeID);
+		return NULL;
 	}
-	else
+
+	CacheEntry *entry = CacheEntryAlloc(key, typeID, expireStamps, now);
+	if (entry == NULL)
 	{
-		// key 已经过期，删除该entry
-		ObjectCacheMngRemoveEntry(mng, index, preEntry, entry);
+		mng->release(obj, typeID);
+		return NULL;
+	}
+
+	entry->obj = obj;
+	ObjectCacheMngLinkEntry(mng, index, entry);
+	return entry;
+}
+
+typedef struct FlushBatch
+{
+	const char **keys;
+	void **objs;
+	int *typeIDs;
+	CacheEntry **entries;
+}FlushBatch;
+
+static void FlushBatchDestory(FlushBatch *batch)
+{
+	if (batch == NULL)
+	{
+		return;
+	}
+
+	free(batch->keys);
+	free(batch->objs);
+	free(batch->typeIDs);
+	free(batch->entries);
+	free(batch);
+}
+
+static FlushBatch* FlushBatchCreate(unsigned int batchSize)
+{
+	FlushBatch *batch = (FlushBatch*)malloc(sizeof(FlushBatch));
+	if (batch == NULL)
+	{
+		return NULL;
+	}
+
+	batch->keys = (const char**)malloc(sizeof(char*) * batchSize);
+	batch->objs = (void**)malloc(sizeof(void*) * batchSize);
+	batch->typeIDs = (int*)malloc(sizeof(int) * batchSize);
+	batch->entries = (CacheEntry**)malloc(sizeof(CacheEntry*) * batchSize);
+	if (batch->keys == NULL || batch->objs == NULL || batch->typeIDs == NULL || batch->entries == NULL)
+	{
+		FlushBatchDestory(batch);
 		return NULL;
 	}
+	return batch;
+}
+
+/*
+ * 在持有锁的情况下同步写出所有dirty的entry，flush不能重入缓存
+ */
+static int ObjectCacheMngFlushAll(ObjectCacheMng *mng)
+{
+	if (mng->dirtyHead == NULL)
+	{
+		return 0;
+	}
+
+	if (mng->flushing)
+	{
+		return ERR_FLUSH_BUSY;
+	}
+
+	FlushBatch *batch = FlushBatchCreate(mng->batchSize);
+	if (batch == NULL)
+	{
+		return ERR_OUT_OF_MEM;
+	}
+
+	int ret = 0;
+	while (mng->dirtyHead != NULL && ret == 0)
+	{
+		unsigned int n = 0;
+		CacheEntry *entry = mng->dirtyHead;
+		for (; entry != NULL && n < mng->batchSize; entry = entry->dirtyNext, ++n)
+		{
+			batch->entries[n] = entry;
+			batch->keys[n] = entry->key;
+			batch->objs[n] = entry->obj;
+			batch->typeIDs[n] = entry->typeID;
+		}
+
+		if (mng->flush(batch->keys, batch->objs, batch->typeIDs, n) != 0)
+		{
+			ret = ERR_FLUSH_FAILED;
+			break;
+		}
+
+		unsigned int i = 0;
+		for (i = 0; i < n; ++i)
+		{
+			ObjectCacheMngUnlinkDirty(mng, batch->entries[i]);
+			batch->entries[i]->dirty = ENTRY_CLEAN;
+		}
+	}
+
+	FlushBatchDestory(batch);
+	return ret;
+}
+
+/*
+ * 后台线程写出一批dirty的entry，写出时不持有锁，写出的是对象的副本
+ * 写出期间flushing为1，其他路径不会调用flush，也不会删除非clean的entry，
+ * 所以批中的entry指针在写出完成后仍然有效
+ */
+static int ObjectCacheMngFlushBatch(ObjectCacheMng *mng, FlushBatch *batch)
+{
+	unsigned int n = 0;
+	while (mng->dirtyHead != NULL && n < mng->batchSize)
+	{
+		CacheEntry *entry = mng->dirtyHead;
+		char *key = strdup(entry->key);
+		void *obj = mng->dump(entry->obj, entry->typeID);
+		if (key == NULL || obj == NULL)
+		{
+			free(key);
+			if (obj != NULL)
+			{
+				mng->release(obj, entry->typeID);
+			}
+			break;
+		}
+
+		ObjectCacheMngUnlinkDirty(mng, entry);
+		entry->dirty = ENTRY_FLUSHING;
+		batch->entries[n] = entry;
+		batch->keys[n] = key;
+		batch->objs[n] = obj;
+		batch->typeIDs[n] = entry->typeID;
+		++n;
+	}
+
+	if (n == 0)
+	{
+		return mng->dirtyHead != NULL ? ERR_OUT_OF_MEM : 0;
+	}
+
+	mng->flushing = 1;
+	pthread_mutex_unlock(&mng->lock);
+	int ret = mng->flush(batch->keys, batch->objs, batch->typeIDs, n);
+	pthread_mutex_lock(&mng->lock);
+	mng->flushing = 0;
+
+	unsigned int i = 0;
+	for (i = 0; i < n; ++i)
+	{
+		// 写出期间再次修改的entry已重新放回dirty链表
+		CacheEntry *entry = batch->entries[i];
+		if (entry->dirty == ENTRY_FLUSHING)
+		{
+			if (ret == 0)
+			{
+				entry->dirty = ENTRY_CLEAN;
+			}
+			else
+			{
+				// 写出失败，重新放回dirty链表
+				ObjectCacheMngMarkDirty(mng, entry);
+			}
+		}
+		mng->release(batch->objs[i], batch->typeIDs[i]);
+		free((char*)batch->keys[i]);
+	}
+	pthread_cond_broadcast(&mng->flushCond);
+	return ret;
+}
+
+static void ObjectCacheMngWait(ObjectCacheMng *mng, uint64_t deadlineMs)
+{
+	struct timespec ts;
+	ts.tv_sec = deadlineMs / 1000;
+	ts.tv_nsec = (deadlineMs % 1000) * 1000000;
+	pthread_cond_timedwait(&mng->cond, &mng->lock, &ts);
+}
+
+/*
+ * 后台写出线程，dirty的entry数达到batchSize或最早的dirty数据超过maxDelayMs时写出一批
+ */
+static void* ObjectCacheFlusher(void *arg)
+{
+	ObjectCacheMng *mng = (ObjectCacheMng*)arg;
+	FlushBatch *batch = FlushBatchCreate(mng->batchSize);
+	if (batch == NULL)
+	{
+		// 由ObjectCacheDestory同步写出
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mng->lock);
+	while (!mng->stopping)
+	{
+		uint64_t now = NowMs();
+		if (mng->dirtyCnt < mng->batchSize)
+		{
+			uint64_t deadline = now + FLUSH_IDLE_MS;
+			if (mng->dirtyHead != NULL)
+			{
+				deadline = mng->dirtyHead->dirtyMs + mng->maxDelayMs;
+			}
+
+			if (now < deadline)
+			{
+				ObjectCacheMngWait(mng, deadline);
+				continue;
+			}
+		}
+
+		if (ObjectCacheMngFlushBatch(mng, batch) != 0)
+		{
+			// 写出失败，稍后重试
+			ObjectCacheMngWait(mng, NowMs() + (mng->maxDelayMs > 0 ? mng->maxDelayMs : FLUSH_IDLE_MS));
+		}
+	}
+	pthread_mutex_unlock(&mng->lock);
+
+	FlushBatchDestory(batch);
 	return NULL;
 }
 
-int ObjectCacheInsert(const char *key, const void *obj, int typeID, unsigned int expireTime)
+int ObjectCacheInit(unsigned int maxKeyCnt, DumpFunc dump, ReleaseFunc release)
 {
-	if (key == NULL || obj == NULL || expireTime == 0)
+	if (maxKeyCnt == 0 || dump == NULL || release == NULL)
 	{
 		return ERR_PARAM_INVALID;
 	}
 
 	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table)
+	{
+		pthread_mutex_unlock(&mng->lock);
+		return ERR_REINIT;
+	}
+
+	unsigned int sizeMask = GenSizeMask(maxKeyCnt);
+	CacheEntry **table = (CacheEntry**)malloc(sizeof(CacheEntry*) * (sizeMask + 1));
+	if (table == NULL)
+	{
+		pthread_mutex_unlock(&mng->lock);
+		return ERR_OUT_OF_MEM;
+	}
+
+	memset(table, 0, sizeof(CacheEntry*) * (sizeMask + 1));
+	mng->table = table;
+	mng->sizeMask = sizeMask;
+	mng->keyCnt = 0;
+	mng->maxKeyCnt = maxKeyCnt;
+	mng->dump = dump;
+	mng->release = release;
+	mng->lostCnt = 0;
+	pthread_mutex_unlock(&mng->lock);
+	return 0;
+}
+
+/*
+ * 删除所有entry，调用前需要先写出dirty的entry
+ * keepDirty为1时保留仍未写出的dirty entry，否则全部丢弃并计入lostCnt
+ */
+static void ObjectCacheMngClear(ObjectCacheMng *mng, int keepDirty)
+{
+	unsigned int i = 0;
+	for (i = 0; i <= mng->sizeMask; ++i)
+	{
+		CacheEntry *entry1 = mng->table[i];
+		CacheEntry *entry2 = entry1;
+		mng->table[i] = NULL;
+		while (entry1 != NULL)
+		{
+			entry2 = entry1->next;
+			if (entry1->dirty != ENTRY_CLEAN && keepDirty)
+			{
+				entry1->next = mng->table[i];
+				mng->table[i] = entry1;
+			}
+			else
+			{
+				if (entry1->dirty != ENTRY_CLEAN)
+				{
+					++mng->lostCnt;
+				}
+				CacheEntryDestory(entry1, mng->release);
+				--mng->keyCnt;
+			}
+			entry1 = entry2;
+		}
+	}
+
+	if (!keepDirty)
+	{
+		mng->dirtyHead = NULL;
+		mng->dirtyTail = NULL;
+		mng->dirtyCnt = 0;
+	}
+	ObjectCacheMngBumpEpoch(mng);
+	if (mng->spill != NULL)
+	{
+		SpillStoreClear(mng->spill);
+	}
+}
+
+void ObjectCacheClear()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	ObjectCacheMngWaitFlushing(mng);
+	if (mng->table != NULL)
+	{
+		if (mng->flush != NULL)
+		{
+			// 写出失败的dirty entry保留在缓存中
+			ObjectCacheMngFlushAll(mng);
+		}
+		ObjectCacheMngClear(mng, 1);
+	}
+	pthread_mutex_unlock(&mng->lock);
+}
+
+void ObjectCacheDestory()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
 	if (mng->table == NULL)
 	{
-		return ERR_NOT_INIT;
+		pthread_mutex_unlock(&mng->lock);
+		return;
+	}
+
+	if (mng->flush != NULL)
+	{
+		// 停止后台线程，并写出所有未写入后端存储的数据
+		mng->stopping = 1;
+		pthread_cond_signal(&mng->cond);
+		pthread_mutex_unlock(&mng->lock);
+		pthread_join(mng->flusher, NULL);
+		pthread_mutex_lock(&mng->lock);
+		ObjectCacheMngFlushAll(mng);
+		mng->stopping = 0;
 	}
 
-	unsigned int index = GenHashValue(key, strlen(key)) & mng->sizeMask;
+	// 仍然写出失败的dirty entry只能丢弃
+	ObjectCacheMngClear(mng, 0);
+	SpillStoreDestory(mng->spill);
+	mng->spill = NULL;
+	ObjectTraceDestory(mng->trace);
+	mng->trace = NULL;
+	__atomic_store_n(&mng->traceSampleRate, 0, __ATOMIC_RELAXED);
+	mng->size = NULL;
+	free(mng->table);
+	mng->table = NULL;
+	mng->sizeMask = 0;
+	mng->maxKeyCnt = 0;
+	mng->defaultExpireTime = 0;
+	mng->dump = NULL;
+	mng->release = NULL;
+	mng->frontCache = 0;
+	mng->flush = NULL;
+	pthread_mutex_unlock(&mng->lock);
+}
+
+static void* ObjectCacheMngGet(ObjectCacheMng *mng, const char *key,
+	unsigned int keyLen, unsigned int hash)
+{
+	time_t now = mng->clock(NULL);
+	unsigned int index = hash & mng->sizeMask;
 	CacheEntry *entry = NULL;
 	CacheEntry *preEntry = NULL;
 	int ret = ObjectCacheMngFindEntry(mng, index, key, &preEntry, &entry);
 	if (ret != 0)
 	{
-		// key 不存在
-		return ObjectCacheMngInsert(mng, index, key, obj, typeID, expireTime);
+		if (mng->spill != NULL)
+		{
+			// 内存中没有，到二级缓存中查找
+			entry = ObjectCacheMngPromote(mng, index, key, hash, now);
+		}
+
+		if (entry == NULL)
+		{
+			if (mng->trace != NULL)
+			{
+				ObjectCacheMngTrace(mng, hash, OBJECT_TRACE_GET_MISS, keyLen, NULL, 0, 0);
+			}
+			return NULL;
+		}
+	}
+	else if (entry->expireStamps > now && !ObjectCacheMngIsStale(mng, entry))
+	{
+		// key 没有过期
+		++entry->visitCnt;
+		entry->visitStamps = now;
+	}
+	else
+	{
+		// key 已经过期或失效，删除该entry，dirty的entry写出失败时保留到之后回收
+		ObjectCacheMngRemoveEntry(mng, index, preEntry, entry);
+		if (mng->trace != NULL)
+		{
+			ObjectCacheMngTrace(mng, hash, OBJECT_TRACE_GET_MISS, keyLen, NULL, 0, 0);
+		}
+		return NULL;
+	}
+
+	if (mng->trace != NULL)
+	{
+		ObjectCacheMngTrace(mng, hash, OBJECT_TRACE_GET_HIT, keyLen, entry->obj, entry->typeID, 0);
+	}
+
+	if (mng->frontCache)
+	{
+		FrontCacheFill(mng, entry, keyLen, hash, now);
+	}
+	return entry->obj;
+}
+
+static int ObjectCacheMngSet(ObjectCacheMng *mng, const char *key, const void *obj,
+	int typeID, unsigned int expireTime)
+{
+	unsigned int keyLen = strlen(key);
+	unsigned int hash = GenHashValue(key, keyLen);
+	time_t now = mng->clock(NULL);
+	if (mng->trace != NULL)
+	{
+		ObjectCacheMngTrace(mng, hash, OBJECT_TRACE_INSERT, keyLen, obj, typeID, expireTime);
+	}
+
+	if (mng->reclaimPending > 0)
+	{
+		ObjectCacheMngReclaim(mng, RECLAIM_STEP, now);
+	}
+
+	unsigned int index = hash & mng->sizeMask;
+	CacheEntry *entry = NULL;
+	CacheEntry *preEntry = NULL;
+	int ret = 0;
+	while (ObjectCacheMngFindEntry(mng, index, key, &preEntry, &entry) != 0)
+	{
+		// key 不存在，缓存已满时先淘汰
+		ret = ObjectCacheMngMakeRoom(mng);
+		if (ret != ERR_FLUSH_BUSY)
+		{
+			break;
+		}
+
+		// 只剩dirty的entry可以淘汰，等后台线程写完这一批后重新查找
+		ObjectCacheMngWaitFlushing(mng);
+		if (mng->table == NULL)
+		{
+			return ERR_NOT_INIT;
+		}
+		index = hash & mng->sizeMask;
+	}
+
+	if (entry == NULL)
+	{
+		if (ret != 0)
+		{
+			return ret;
+		}
+
+		// 二级缓存中的旧数据需要作废
+		if (mng->spill != NULL)
+		{
+			SpillStoreRemove(mng->spill, key, hash);
+		}
+		ret = ObjectCacheMngInsert(mng, index, key, obj, typeID, expireTime, now);
+		entry = mng->table[index];
 	}
 	else
 	{
-		return CacheEntrySet(entry, obj, typeID, expireTime, mng->dump, mng->release);
+		ret = CacheEntrySet(entry, obj, typeID, expireTime, now, mng->dump, mng->release);
+		entry->generation = ObjectCacheMngGeneration(mng, entry->typeID);
+		ObjectCacheMngBumpVersion(mng, entry);
+	}
+
+	if (ret == 0 && mng->flush != NULL)
+	{
+		// write-behind模式，由后台线程批量写入后端存储
+		ObjectCacheMngMarkDirty(mng, entry);
+	}
+	return ret;
+}
+
+void* ObjectCacheGet(const char *key)
+{
+	if (key == NULL)
+	{
+		return NULL;
+	}
+
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	unsigned int keyLen = strlen(key);
+	unsigned int hash = GenHashValue(key, keyLen);
+	void *obj = NULL;
+	if (mng->frontCache)
+	{
+		// 前端缓存命中时不需要加锁，只有被采样的key才加锁写访问记录
+		int typeID = 0;
+		obj = FrontCacheGet(mng, key, hash, mng->clock(NULL), &typeID);
+		if (obj != NULL)
+		{
+			unsigned int sampleRate = __atomic_load_n(&mng->traceSampleRate, __ATOMIC_RELAXED);
+			if (sampleRate != 0 && ObjectTraceSampled(sampleRate, hash))
+			{
+				pthread_mutex_lock(&mng->lock);
+				if (mng->trace != NULL)
+				{
+					ObjectCacheMngTrace(mng, hash, OBJECT_TRACE_GET_HIT, keyLen, obj, typeID, 0);
+				}
+				pthread_mutex_unlock(&mng->lock);
+			}
+			return obj;
+		}
+	}
+
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table != NULL)
+	{
+		obj = ObjectCacheMngGet(mng, key, keyLen, hash);
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return obj;
+}
+
+int ObjectCacheInsert(const char *key, const void *obj, int typeID, unsigned int expireTime)
+{
+	if (key == NULL || obj == NULL)
+	{
+		return ERR_PARAM_INVALID;
 	}
 
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = ERR_NOT_INIT;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table != NULL)
+	{
+		if (expireTime == 0)
+		{
+			expireTime = mng->defaultExpireTime;
+		}
+		ret = expireTime > 0 ? ObjectCacheMngSet(mng, key, obj, typeID, expireTime) : ERR_PARAM_INVALID;
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+int ObjectCacheEnableSpill(const char *fileName, unsigned int maxBytes,
+	SerializeFunc serialize, DeserializeFunc deserialize)
+{
+	if (fileName == NULL || maxBytes == 0 || serialize == NULL || deserialize == NULL)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = 0;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table == NULL)
+	{
+		ret = ERR_NOT_INIT;
+	}
+	else if (mng->spill != NULL)
+	{
+		ret = ERR_REINIT;
+	}
+	else
+	{
+		mng->spill = SpillStoreCreate(fileName, maxBytes, serialize, deserialize);
+		if (mng->spill == NULL)
+		{
+			ret = ERR_OPEN_SPILL;
+		}
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+void ObjectCacheSpillCompact()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	if (mng->spill != NULL)
+	{
+		SpillStoreCompact(mng->spill);
+	}
+	pthread_mutex_unlock(&mng->lock);
+}
+
+int ObjectCacheEnableFrontCache()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = ERR_NOT_INIT;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table != NULL)
+	{
+		mng->frontCache = 1;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+int ObjectCacheTraceStart(const char *fileName, unsigned int sampleRate, SizeFunc size)
+{
+	if (fileName == NULL || sampleRate == 0)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = 0;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table == NULL)
+	{
+		ret = ERR_NOT_INIT;
+	}
+	else if (mng->trace != NULL)
+	{
+		ret = ERR_REINIT;
+	}
+	else
+	{
+		mng->trace = ObjectTraceCreate(fileName, sampleRate);
+		if (mng->trace == NULL)
+		{
+			ret = ERR_OPEN_TRACE;
+		}
+		else
+		{
+			__atomic_store_n(&mng->traceSampleRate, sampleRate, __ATOMIC_RELAXED);
+		}
+		mng->size = size;
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+void ObjectCacheTraceStop()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	ObjectTraceDestory(mng->trace);
+	mng->trace = NULL;
+	__atomic_store_n(&mng->traceSampleRate, 0, __ATOMIC_RELAXED);
+	mng->size = NULL;
+	pthread_mutex_unlock(&mng->lock);
+}
+
+void ObjectCacheSetClock(ClockFunc clock)
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	mng->clock = clock != NULL ? clock : time;
+	pthread_mutex_unlock(&mng->lock);
+}
+
+void ObjectCacheInvalidateAll()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table != NULL)
+	{
+		++mng->generation;
+		ObjectCacheMngInvalidated(mng);
+	}
+	pthread_mutex_unlock(&mng->lock);
+}
+
+void ObjectCacheInvalidateType(int typeID)
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table == NULL)
+	{
+		pthread_mutex_unlock(&mng->lock);
+		return;
+	}
+
+	TypeGeneration *typeGen = ObjectCacheMngFindTypeGen(mng, typeID, 1);
+	if (typeGen != NULL)
+	{
+		++typeGen->generation;
+	}
+	else
+	{
+		// 记录typeID版本号的槽已用完，退化为全部失效
+		++mng->generation;
+	}
+	ObjectCacheMngInvalidated(mng);
+	pthread_mutex_unlock(&mng->lock);
+}
+
+unsigned int ObjectCacheReclaim(unsigned int bucketCnt)
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	unsigned int removed = 0;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table != NULL)
+	{
+		removed = ObjectCacheMngReclaim(mng, bucketCnt, mng->clock(NULL));
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return removed;
+}
+
+int ObjectCacheEnableWriteBehind(FlushFunc flush, unsigned int batchSize, unsigned int maxDelayMs)
+{
+	if (flush == NULL || batchSize == 0)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = 0;
+	pthread_mutex_lock(&mng->lock);
+	if (mng->table == NULL)
+	{
+		ret = ERR_NOT_INIT;
+	}
+	else if (mng->flush != NULL)
+	{
+		ret = ERR_REINIT;
+	}
+	else
+	{
+		mng->flush = flush;
+		mng->batchSize = batchSize;
+		mng->maxDelayMs = maxDelayMs;
+		mng->stopping = 0;
+		if (pthread_create(&mng->flusher, NULL, ObjectCacheFlusher, mng) != 0)
+		{
+			mng->flush = NULL;
+			ret = ERR_CREATE_THREAD;
+		}
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+int ObjectCacheFlush()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	int ret = 0;
+	pthread_mutex_lock(&mng->lock);
+	ObjectCacheMngWaitFlushing(mng);
+	if (mng->flush != NULL)
+	{
+		ret = ObjectCacheMngFlushAll(mng);
+	}
+	pthread_mutex_unlock(&mng->lock);
+	return ret;
+}
+
+unsigned int ObjectCacheFlushLost()
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	unsigned int lostCnt = mng->lostCnt;
+	pthread_mutex_unlock(&mng->lock);
+	return lostCnt;
+}
+
+int ObjectCacheResize(unsigned int maxKeyCnt)
+{
+	if (maxKeyCnt == 0)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	ObjectCacheMngWaitFlushing(mng);
+	if (mng->table == NULL)
+	{
+		pthread_mutex_unlock(&mng->lock);
+		return ERR_NOT_INIT;
+	}
+
+	unsigned int sizeMask = GenSizeMask(maxKeyCnt);
+	if (sizeMask != mng->sizeMask)
+	{
+		CacheEntry **table = (CacheEntry**)malloc(sizeof(CacheEntry*) * (sizeMask + 1));
+		if (table == NULL)
+		{
+			pthread_mutex_unlock(&mng->lock);
+			return ERR_OUT_OF_MEM;
+		}
+		memset(table, 0, sizeof(CacheEntry*) * (sizeMask + 1));
+
+		// 把所有entry重新散列到新表中
+		unsigned int i = 0;
+		for (i = 0; i <= mng->sizeMask; ++i)
+		{
+			CacheEntry *entry = mng->table[i];
+			while (entry != NULL)
+			{
+				CacheEntry *next = entry->next;
+				unsigned int index = entry->hash & sizeMask;
+				entry->next = table[index];
+				table[index] = entry;
+				entry = next;
+			}
+		}
+
+		free(mng->table);
+		mng->table = table;
+		mng->sizeMask = sizeMask;
+		mng->reclaimCursor = 0;
+		if (mng->reclaimPending > 0)
+		{
+			mng->reclaimPending = sizeMask + 1;
+		}
+	}
+
+	// 容量变小时淘汰多出的entry，dirty的entry写出失败时会保留，之后的Insert会继续淘汰
+	mng->maxKeyCnt = maxKeyCnt;
+	while (mng->keyCnt > maxKeyCnt)
+	{
+		if (ObjectCacheMngDieOut(mng) != 0)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mng->lock);
 	return 0;
 }
+
+void ObjectCacheSetDefaultExpireTime(unsigned int expireTime)
+{
+	ObjectCacheMng *mng = ObjectCacheMngInstance();
+	pthread_mutex_lock(&mng->lock);
+	mng->defaultExpireTime = expireTime;
+	pthread_mutex_unlock(&mng->lock);
+}
@@ -1,19 +1,132 @@
 #ifndef _OBJECT_CACHE_H
 #define _OBJECT_CACHE_H
 
+#include <time.h>
+
+struct ConfigReader;
+
 #define ERR_NOT_INIT -1001
 #define ERR_REINIT -1002
 #define ERR_PARAM_INVALID -1003
 #define ERR_OUT_OF_MEM -1004
+#define ERR_OPEN_SPILL -1005
+#define ERR_OPEN_TRACE -1006
+#define ERR_CREATE_THREAD -1007
+#define ERR_FLUSH_FAILED -1008
 
 typedef void*(*DumpFunc)(const void *obj, int typeID);
 typedef void(*ReleaseFunc)(void *obj, int typeID);
 
+/*
+ * 把对象序列化到buf中，buf为NULL或bufLen不足时只返回需要的字节数
+ * @return 序列化后的字节数，小于0表示该对象不能写入L2
+ */
+typedef int(*SerializeFunc)(const void *obj, int typeID, char *buf, unsigned int bufLen);
+/*
+ * 从buf中反序列化出对象，返回的对象与DumpFunc返回的对象一样由ReleaseFunc释放
+ */
+typedef void*(*DeserializeFunc)(const char *buf, unsigned int len, int typeID);
+/*
+ * 返回对象占用的字节数，用于访问记录
+ */
+typedef unsigned int(*SizeFunc)(const void *obj, int typeID);
+typedef time_t(*ClockFunc)(time_t *now);
+/*
+ * 把count个对象写入后端存储，同一个key在一批中只出现一次
+ * flush不会被并发调用，同一个key较新的数据总是在较旧的数据之后写出
+ * 只有后台线程在不持有缓存的锁时调用flush；ObjectCacheFlush、淘汰、删除、
+ * ObjectCacheClear和ObjectCacheDestory中的同步写出持有锁调用flush，
+ * 所以flush中不能调用任何ObjectCache*函数，否则会死锁
+ * @return 0成功，非0失败，失败的对象之后会重新写出
+ */
+typedef int(*FlushFunc)(const char **keys, void **objs, const int *typeIDs, int count);
+
 int ObjectCacheInit(unsigned int maxKeyCnt, DumpFunc dump, ReleaseFunc release);
 void ObjectCacheClear();
 void ObjectCacheDestory();
 
 void* ObjectCacheGet(const char *key);
+/*
+ * expireTime为0时使用ObjectCacheSetDefaultExpireTime设置的默认过期时间
+ */
 int ObjectCacheInsert(const char *key, const void *obj, int typeID, unsigned int expireTime);
 
+/*
+ * 在线修改容量，不丢失已缓存的对象，容量变小时淘汰多出的对象
+ */
+int ObjectCacheResize(unsigned int maxKeyCnt);
+void ObjectCacheSetDefaultExpireTime(unsigned int expireTime);
+
+/*
+ * 从ConfigReader的section中读取配置创建缓存，支持的配置项:
+ *     max_keys=最大key数
+ *     default_ttl_ms=默认过期时间(毫秒)，按秒向上取整
+ * ObjectCacheApplyConfig在运行中重新应用section中的配置，不丢失已缓存的对象
+ */
+int ObjectCacheInitFromConfig(const struct ConfigReader *reader, const char *section,
+	DumpFunc dump, ReleaseFunc release);
+int ObjectCacheApplyConfig(const struct ConfigReader *reader, const char *section);
+
+/*
+ * 开启二级缓存(L2)，被淘汰的对象会写入大小为maxBytes的内存映射文件fileName中，
+ * ObjectCacheGet在内存中找不到对象时会到L2中查找，找到后重新放回内存
+ */
+int ObjectCacheEnableSpill(const char *fileName, unsigned int maxBytes,
+	SerializeFunc serialize, DeserializeFunc deserialize);
+/*
+ * 回收L2中无效记录占用的空间，可以在空闲时定期调用
+ */
+void ObjectCacheSpillCompact();
+
+/*
+ * 开启线程本地的前端缓存(L0)，重复访问的热点key直接在本线程内命中，命中时不加锁，
+ * 未命中时回到加锁的共享表。共享表中的entry被删除、修改或过期后前端缓存随即失效，
+ * 版本号按key的hash分条带记录，淘汰其他key不会使热点key失效
+ */
+int ObjectCacheEnableFrontCache();
+
+/*
+ * 开始记录访问，按key采样，每sampleRate个key记录一个，
+ * 记录的内容为key的hash值、操作类型、时间和大小，可以用tools/cache_sim回放
+ * size为NULL时大小只计算key的长度
+ */
+int ObjectCacheTraceStart(const char *fileName, unsigned int sampleRate, SizeFunc size);
+void ObjectCacheTraceStop();
+
+/*
+ * 替换缓存使用的时钟，默认为time，用于回放访问记录
+ */
+void ObjectCacheSetClock(ClockFunc clock);
+
+/*
+ * 使所有对象或typeID类型的对象失效，时间复杂度为O(1)
+ * 失效的对象在ObjectCacheGet中视为不存在，占用的内存在之后的ObjectCacheInsert中分批回收，
+ * 也可以调用ObjectCacheReclaim主动回收
+ */
+void ObjectCacheInvalidateAll();
+void ObjectCacheInvalidateType(int typeID);
+/*
+ * 清理bucketCnt个桶中过期或已失效的对象，返回回收的对象数
+ */
+unsigned int ObjectCacheReclaim(unsigned int bucketCnt);
+
+/*
+ * 开启write-behind模式，ObjectCacheInsert只修改缓存并把对象标记为dirty，
+ * 同一个key的多次修改只写出最后一次，后台线程在dirty对象数达到batchSize
+ * 或最早的dirty对象超过maxDelayMs毫秒时批量调用flush写入后端存储
+ * dirty对象在被淘汰或删除前会先同步写出，写出失败时保留在缓存中，
+ * 缓存已满且只剩写出失败的dirty对象时ObjectCacheInsert返回ERR_FLUSH_FAILED
+ * ObjectCacheDestory会写出所有dirty对象，仍然写出失败的对象被丢弃，个数由ObjectCacheFlushLost返回
+ */
+int ObjectCacheEnableWriteBehind(FlushFunc flush, unsigned int batchSize, unsigned int maxDelayMs);
+/*
+ * 同步写出所有dirty对象，后台线程正在写出时等它写完
+ * 写出时持有缓存的锁，写出期间其他线程对缓存的访问都会等待
+ */
+int ObjectCacheFlush();
+/*
+ * 上次ObjectCacheDestory时因写出失败而丢弃的dirty对象数，ObjectCacheInit时清零
+ */
+unsigned int ObjectCacheFlushLost();
+
 #endif
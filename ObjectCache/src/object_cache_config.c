@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "config_reader.h"
+#include "object_cache.h"
+
+#define CONFIG_MAX_KEYS "max_keys"
+#define CONFIG_DEFAULT_TTL_MS "default_ttl_ms"
+#define CONFIG_MAX_TTL_MS ((unsigned long long)UINT_MAX * 1000)	// 按秒向上取整后不超过unsigned int
+
+/*
+ * 读取无符号整数配置项，配置项不存在时返回0并保持*value不变
+ * @return 1读取成功，0配置项不存在，小于0格式错误或超过max
+ */
+static int ConfigGetUInt(const ConfigReader *reader, const char *section,
+	const char *key, unsigned long long max, unsigned long long *value)
+{
+	const char *str = ConfigReaderGetValue(reader, section, key);
+	if (str[0] == '\0')
+	{
+		return 0;
+	}
+
+	char *end = NULL;
+	errno = 0;
+	unsigned long long n = strtoull(str, &end, 10);
+	if (*end != '\0' || str[0] == '-' || errno == ERANGE || n > max)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	*value = n;
+	return 1;
+}
+
+int ObjectCacheInitFromConfig(const ConfigReader *reader, const char *section,
+	DumpFunc dump, ReleaseFunc release)
+{
+	if (reader == NULL || section == NULL)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	unsigned long long maxKeyCnt = 0;
+	if (ConfigGetUInt(reader, section, CONFIG_MAX_KEYS, UINT_MAX, &maxKeyCnt) <= 0 || maxKeyCnt == 0)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	int ret = ObjectCacheInit((unsigned int)maxKeyCnt, dump, release);
+	if (ret != 0)
+	{
+		return ret;
+	}
+
+	ret = ObjectCacheApplyConfig(reader, section);
+	if (ret != 0)
+	{
+		ObjectCacheDestory();
+	}
+	return ret;
+}
+
+int ObjectCacheApplyConfig(const ConfigReader *reader, const char *section)
+{
+	if (reader == NULL || section == NULL)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	unsigned long long maxKeyCnt = 0;
+	unsigned long long ttlMs = 0;
+	int hasMaxKeyCnt = ConfigGetUInt(reader, section, CONFIG_MAX_KEYS, UINT_MAX, &maxKeyCnt);
+	int hasTtl = ConfigGetUInt(reader, section, CONFIG_DEFAULT_TTL_MS, CONFIG_MAX_TTL_MS, &ttlMs);
+	if (hasMaxKeyCnt < 0 || hasTtl < 0 || (hasMaxKeyCnt > 0 && maxKeyCnt == 0))
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	if (hasMaxKeyCnt > 0)
+	{
+		int ret = ObjectCacheResize((unsigned int)maxKeyCnt);
+		if (ret != 0)
+		{
+			return ret;
+		}
+	}
+
+	if (hasTtl > 0)
+	{
+		ObjectCacheSetDefaultExpireTime((unsigned int)((ttlMs + 999) / 1000));
+	}
+	return 0;
+}
@@ -0,0 +1,397 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "object_spill.h"
+
+#define SPILL_ALIGN(n) (((n) + 7) & ~7U)
+#define SPILL_SLOT_EMPTY 0
+#define SPILL_SLOT_DELETED 0xFFFFFFFF
+#define SPILL_MIN_SLOTS 64
+
+typedef struct SpillRecord
+{
+	uint32_t keyLen;
+	uint32_t dataLen;
+	int32_t typeID;
+	uint32_t hash;
+	uint32_t live;
+	uint32_t reserved;
+	int64_t expireStamps;
+	uint64_t generation;
+	// 紧跟着key(以'\0'结尾)和序列化后的数据
+}SpillRecord;
+
+typedef struct SpillSlot
+{
+	uint32_t hash;
+	uint32_t offset;	// 记录在文件中的偏移+1, 0表示空槽
+}SpillSlot;
+
+struct SpillStore
+{
+	int fd;
+	char *base;				// 映射文件的起始地址
+	unsigned int capacity;	// 映射文件的大小
+	unsigned int tail;		// 日志的尾部，新记录追加在这里
+	unsigned int deadBytes;	// 无效记录占用的字节数
+	SpillSlot *slots;
+	unsigned int slotMask;
+	unsigned int usedSlots;	// 已使用的槽数，包括已删除的槽
+	unsigned int liveCnt;	// 有效记录数
+	SerializeFunc serialize;
+	DeserializeFunc deserialize;
+};
+
+static unsigned int SpillRecordSize(const SpillRecord *rec)
+{
+	return SPILL_ALIGN(sizeof(SpillRecord) + rec->keyLen + 1 + rec->dataLen);
+}
+
+static SpillRecord* SpillStoreRecord(const SpillStore *store, uint32_t offset)
+{
+	return (SpillRecord*)(store->base + offset);
+}
+
+static int SpillStoreFindSlot(const SpillStore *store, const char *key, unsigned int hash)
+{
+	unsigned int i = hash & store->slotMask;
+	while (store->slots[i].offset != SPILL_SLOT_EMPTY)
+	{
+		const SpillSlot *slot = store->slots + i;
+		if (slot->offset != SPILL_SLOT_DELETED && slot->hash == hash)
+		{
+			const SpillRecord *rec = SpillStoreRecord(store, slot->offset - 1);
+			if (strcmp((const char*)(rec + 1), key) == 0)
+			{
+				return (int)i;
+			}
+		}
+		i = (i + 1) & store->slotMask;
+	}
+	return -1;
+}
+
+static int SpillStoreResizeIndex(SpillStore *store, unsigned int slotCnt)
+{
+	SpillSlot *slots = (SpillSlot*)calloc(slotCnt, sizeof(SpillSlot));
+	if (slots == NULL)
+	{
+		return ERR_OUT_OF_MEM;
+	}
+
+	unsigned int slotMask = slotCnt - 1;
+	unsigned int usedSlots = 0;
+	unsigned int i = 0;
+	for (i = 0; store->slots != NULL && i <= store->slotMask; ++i)
+	{
+		SpillSlot *slot = store->slots + i;
+		if (slot->offset == SPILL_SLOT_EMPTY || slot->offset == SPILL_SLOT_DELETED)
+		{
+			continue;
+		}
+
+		unsigned int j = slot->hash & slotMask;
+		while (slots[j].offset != SPILL_SLOT_EMPTY)
+		{
+			j = (j + 1) & slotMask;
+		}
+		slots[j] = *slot;
+		++usedSlots;
+	}
+
+	free(store->slots);
+	store->slots = slots;
+	store->slotMask = slotMask;
+	store->usedSlots = usedSlots;
+	return 0;
+}
+
+static int SpillStoreAddSlot(SpillStore *store, unsigned int hash, uint32_t offset)
+{
+	// 装载因子保持在0.5以下，已删除的槽较多时只做清理不扩容
+	if ((store->usedSlots + 1) * 2 > store->slotMask + 1)
+	{
+		unsigned int slotCnt = store->slotMask + 1;
+		if ((store->liveCnt + 1) * 4 > slotCnt)
+		{
+			slotCnt *= 2;
+		}
+		int ret = SpillStoreResizeIndex(store, slotCnt);
+		if (ret != 0)
+		{
+			return ret;
+		}
+	}
+
+	unsigned int i = hash & store->slotMask;
+	while (store->slots[i].offset != SPILL_SLOT_EMPTY)
+	{
+		i = (i + 1) & store->slotMask;
+	}
+	store->slots[i].hash = hash;
+	store->slots[i].offset = offset + 1;
+	++store->usedSlots;
+	++store->liveCnt;
+	return 0;
+}
+
+static void SpillStoreKill(SpillStore *store, int slotIndex)
+{
+	SpillSlot *slot = store->slots + slotIndex;
+	SpillRecord *rec = SpillStoreRecord(store, slot->offset - 1);
+	rec->live = 0;
+	store->deadBytes += SpillRecordSize(rec);
+	slot->offset = SPILL_SLOT_DELETED;
+	--store->liveCnt;
+}
+
+/*
+ * 整理日志，把有效记录向文件头部移动
+ * reserve为整理后尾部至少需要空出的字节数，空间不足时从头部开始丢弃最旧的有效记录
+ */
+static void SpillStoreCompactReserve(SpillStore *store, unsigned int reserve)
+{
+	unsigned int liveBytes = store->tail - store->deadBytes;
+	unsigned int dropBytes = 0;
+	if (store->capacity - liveBytes < reserve)
+	{
+		dropBytes = reserve - (store->capacity - liveBytes);
+	}
+
+	unsigned int src = 0;
+	unsigned int dst = 0;
+	while (src < store->tail)
+	{
+		SpillRecord *rec = SpillStoreRecord(store, src);
+		unsigned int size = SpillRecordSize(rec);
+		if (rec->live)
+		{
+			// 找到记录对应的索引槽
+			unsigned int i = rec->hash & store->slotMask;
+			while (store->slots[i].offset != src + 1)
+			{
+				i = (i + 1) & store->slotMask;
+			}
+
+			if (dropBytes > 0)
+			{
+				// 空间不足，丢弃最旧的记录
+				store->slots[i].offset = SPILL_SLOT_DELETED;
+				--store->liveCnt;
+				dropBytes = dropBytes > size ? dropBytes - size : 0;
+			}
+			else
+			{
+				if (src != dst)
+				{
+					memmove(store->base + dst, rec, size);
+					store->slots[i].offset = dst + 1;
+				}
+				dst += size;
+			}
+		}
+		src += size;
+	}
+
+	store->tail = dst;
+	store->deadBytes = 0;
+	// 清理已删除的槽
+	SpillStoreResizeIndex(store, store->slotMask + 1);
+}
+
+SpillStore* SpillStoreCreate(const char *fileName, unsigned int maxBytes,
+	SerializeFunc serialize, DeserializeFunc deserialize)
+{
+	if (maxBytes < sizeof(SpillRecord) || maxBytes == SPILL_SLOT_DELETED)
+	{
+		return NULL;
+	}
+
+	SpillStore *store = (SpillStore*)malloc(sizeof(SpillStore));
+	if (store == NULL)
+	{
+		return NULL;
+	}
+
+	maxBytes &= ~7U;
+	store->fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (store->fd < 0)
+	{
+		free(store);
+		return NULL;
+	}
+
+	if (ftruncate(store->fd, maxBytes) != 0)
+	{
+		close(store->fd);
+		free(store);
+		return NULL;
+	}
+
+	store->base = (char*)mmap(NULL, maxBytes, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	if (store->base == MAP_FAILED)
+	{
+		close(store->fd);
+		free(store);
+		return NULL;
+	}
+
+	store->capacity = maxBytes;
+	store->tail = 0;
+	store->deadBytes = 0;
+	store->slots = NULL;
+	store->slotMask = 0;
+	store->usedSlots = 0;
+	store->liveCnt = 0;
+	store->serialize = serialize;
+	store->deserialize = deserialize;
+	if (SpillStoreResizeIndex(store, SPILL_MIN_SLOTS) != 0)
+	{
+		SpillStoreDestory(store);
+		return NULL;
+	}
+	return store;
+}
+
+void SpillStoreDestory(SpillStore *store)
+{
+	if (store == NULL)
+	{
+		return;
+	}
+
+	munmap(store->base, store->capacity);
+	close(store->fd);
+	free(store->slots);
+	free(store);
+}
+
+void SpillStoreClear(SpillStore *store)
+{
+	memset(store->slots, 0, sizeof(SpillSlot) * (store->slotMask + 1));
+	store->usedSlots = 0;
+	store->liveCnt = 0;
+	store->tail = 0;
+	store->deadBytes = 0;
+}
+
+int SpillStorePut(SpillStore *store, const char *key, unsigned int hash,
+	const void *obj, int typeID, time_t expireStamps, uint64_t generation)
+{
+	SpillStoreRemove(store, key, hash);
+
+	unsigned int keyLen = strlen(key);
+	unsigned int headLen = sizeof(SpillRecord) + keyLen + 1;
+	if (headLen >= store->capacity)
+	{
+		return ERR_PARAM_INVALID;
+	}
+
+	int tries = 0;
+	for (tries = 0; tries < 2; ++tries)
+	{
+		unsigned int avail = 0;
+		if (store->capacity - store->tail > headLen)
+		{
+			avail = store->capacity - store->tail - headLen;
+		}
+
+		char *data = store->base + store->tail + headLen;
+		int dataLen = store->serialize(obj, typeID, avail > 0 ? data : NULL, avail);
+		if (dataLen < 0)
+		{
+			return ERR_PARAM_INVALID;
+		}
+
+		if ((unsigned int)dataLen > avail)
+		{
+			// 空间不足，整理后再试一次
+			if ((unsigned int)dataLen > store->capacity - headLen)
+			{
+				return ERR_OUT_OF_MEM;
+			}
+			SpillStoreCompactReserve(store, SPILL_ALIGN(headLen + dataLen));
+			continue;
+		}
+
+		SpillRecord *rec = SpillStoreRecord(store, store->tail);
+		rec->keyLen = keyLen;
+		rec->dataLen = dataLen;
+		rec->typeID = typeID;
+		rec->hash = hash;
+		rec->live = 1;
+		rec->reserved = 0;
+		rec->expireStamps = expireStamps;
+		rec->generation = generation;
+		memcpy(rec + 1, key, keyLen + 1);
+
+		int ret = SpillStoreAddSlot(store, hash, store->tail);
+		if (ret != 0)
+		{
+			return ret;
+		}
+		store->tail += SpillRecordSize(rec);
+		return 0;
+	}
+	return ERR_OUT_OF_MEM;
+}
+
+void* SpillStoreTake(SpillStore *store, const char *key, unsigned int hash,
+	time_t now, int *typeID, time_t *expireStamps, uint64_t *generation)
+{
+	int i = SpillStoreFindSlot(store, key, hash);
+	if (i < 0)
+	{
+		return NULL;
+	}
+
+	SpillRecord *rec = SpillStoreRecord(store, store->slots[i].offset - 1);
+	void *obj = NULL;
+	if (rec->expireStamps > now)
+	{
+		const char *data = (const char*)(rec + 1) + rec->keyLen + 1;
+		obj = store->deserialize(data, rec->dataLen, rec->typeID);
+		*typeID = rec->typeID;
+		*expireStamps = rec->expireStamps;
+		*generation = rec->generation;
+	}
+	SpillStoreKill(store, i);
+	return obj;
+}
+
+int SpillStoreContains(SpillStore *store, const char *key, unsigned int hash, time_t now)
+{
+	int i = SpillStoreFindSlot(store, key, hash);
+	if (i < 0)
+	{
+		return 0;
+	}
+
+	if (SpillStoreRecord(store, store->slots[i].offset - 1)->expireStamps <= now)
+	{
+		SpillStoreKill(store, i);
+		return 0;
+	}
+	return 1;
+}
+
+void SpillStoreRemove(SpillStore *store, const char *key, unsigned int hash)
+{
+	int i = SpillStoreFindSlot(store, key, hash);
+	if (i >= 0)
+	{
+		SpillStoreKill(store, i);
+	}
+}
+
+void SpillStoreCompact(SpillStore *store)
+{
+	if (store->deadBytes > 0)
+	{
+		SpillStoreCompactReserve(store, 0);
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _OBJECT_SPILL_H
+#define _OBJECT_SPILL_H
+
+#include <time.h>
+#include <stdint.h>
+
+#include "object_cache.h"
+
+/*
+ * ObjectCache的二级缓存(L2)
+ * 被淘汰的对象序列化后以日志方式追加到内存映射的文件中，
+ * 内存中只保留一个紧凑的索引(hash + 文件偏移)
+ */
+typedef struct SpillStore SpillStore;
+
+SpillStore* SpillStoreCreate(const char *fileName, unsigned int maxBytes,
+	SerializeFunc serialize, DeserializeFunc deserialize);
+void SpillStoreDestory(SpillStore *store);
+void SpillStoreClear(SpillStore *store);
+
+/*
+ * 把对象写入L2，key已存在时旧的记录被标记为无效
+ * generation为对象写入时的版本号，取出时原样返回
+ * @return 0成功，非0失败(对象过大或序列化失败)
+ */
+int SpillStorePut(SpillStore *store, const char *key, unsigned int hash,
+	const void *obj, int typeID, time_t expireStamps, uint64_t generation);
+
+/*
+ * 从L2中取出对象，取出后L2中的记录被标记为无效
+ * @return 反序列化后的对象，不存在或已过期返回NULL
+ */
+void* SpillStoreTake(SpillStore *store, const char *key, unsigned int hash,
+	time_t now, int *typeID, time_t *expireStamps, uint64_t *generation);
+
+/*
+ * 查询L2中是否有key对应的未过期对象，已过期的记录被标记为无效
+ * @return 1存在，0不存在
+ */
+int SpillStoreContains(SpillStore *store, const char *key, unsigned int hash, time_t now);
+
+void SpillStoreRemove(SpillStore *store, const char *key, unsigned int hash);
+
+/*
+ * 回收无效记录占用的空间
+ */
+void SpillStoreCompact(SpillStore *store);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "object_trace.h"
+
+#define TRACE_BUF_CNT 4096
+
+struct ObjectTrace
+{
+	FILE *file;
+	unsigned int sampleRate;
+	ObjectTraceRecord *active;		// 正在追加记录的缓冲区
+	unsigned int recordCnt;			// active中的记录数
+	ObjectTraceRecord *pending;		// 等待写线程写入文件的缓冲区，NULL表示没有
+	ObjectTraceRecord *spare;		// 写线程已写完、可以交换的缓冲区，NULL表示正在使用
+	int stopping;
+	pthread_mutex_t lock;			// 保护pending、spare和stopping
+	pthread_cond_t cond;
+	pthread_t writer;
+	ObjectTraceRecord buffers[2][TRACE_BUF_CNT];
+};
+
+/*
+ * 后台写线程，把写满的缓冲区写入文件，写文件时不持有锁
+ */
+static void* ObjectTraceWriter(void *arg)
+{
+	ObjectTrace *trace = (ObjectTrace*)arg;
+	pthread_mutex_lock(&trace->lock);
+	while (1)
+	{
+		if (trace->pending != NULL)
+		{
+			ObjectTraceRecord *records = trace->pending;
+			trace->pending = NULL;
+			pthread_mutex_unlock(&trace->lock);
+			fwrite(records, sizeof(ObjectTraceRecord), TRACE_BUF_CNT, trace->file);
+			pthread_mutex_lock(&trace->lock);
+			trace->spare = records;
+			continue;
+		}
+
+		if (trace->stopping)
+		{
+			break;
+		}
+		pthread_cond_wait(&trace->cond, &trace->lock);
+	}
+	pthread_mutex_unlock(&trace->lock);
+	return NULL;
+}
+
+/*
+ * active写满后与写线程交换缓冲区，写线程还没写完上一块时丢弃这一块的记录，
+ * 追加记录的线程不会等待文件IO
+ */
+static void ObjectTraceSwap(ObjectTrace *trace)
+{
+	pthread_mutex_lock(&trace->lock);
+	if (trace->spare != NULL)
+	{
+		trace->pending = trace->active;
+		trace->active = trace->spare;
+		trace->spare = NULL;
+		pthread_cond_signal(&trace->cond);
+	}
+	trace->recordCnt = 0;
+	pthread_mutex_unlock(&trace->lock);
+}
+
+ObjectTrace* ObjectTraceCreate(const char *fileName, unsigned int sampleRate)
+{
+	ObjectTrace *trace = (ObjectTrace*)malloc(sizeof(ObjectTrace));
+	if (trace == NULL)
+	{
+		return NULL;
+	}
+
+	trace->file = fopen(fileName, "wb");
+	if (trace->file == NULL)
+	{
+		free(trace);
+		return NULL;
+	}
+
+	ObjectTraceHeader header;
+	memcpy(header.magic, OBJECT_TRACE_MAGIC, sizeof(header.magic));
+	header.sampleRate = sampleRate;
+	header.recordSize = sizeof(ObjectTraceRecord);
+	if (fwrite(&header, sizeof(header), 1, trace->file) != 1)
+	{
+		fclose(trace->file);
+		free(trace);
+		return NULL;
+	}
+
+	trace->sampleRate = sampleRate;
+	trace->active = trace->buffers[0];
+	trace->recordCnt = 0;
+	trace->pending = NULL;
+	trace->spare = trace->buffers[1];
+	trace->stopping = 0;
+	pthread_mutex_init(&trace->lock, NULL);
+	pthread_cond_init(&trace->cond, NULL);
+	if (pthread_create(&trace->writer, NULL, ObjectTraceWriter, trace) != 0)
+	{
+		pthread_cond_destroy(&trace->cond);
+		pthread_mutex_destroy(&trace->lock);
+		fclose(trace->file);
+		free(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+void ObjectTraceDestory(ObjectTrace *trace)
+{
+	if (trace == NULL)
+	{
+		return;
+	}
+
+	// 写线程写完已交换的缓冲区后退出，剩余的记录在这里写入
+	pthread_mutex_lock(&trace->lock);
+	trace->stopping = 1;
+	pthread_cond_signal(&trace->cond);
+	pthread_mutex_unlock(&trace->lock);
+	pthread_join(trace->writer, NULL);
+
+	if (trace->recordCnt > 0)
+	{
+		fwrite(trace->active, sizeof(ObjectTraceRecord), trace->recordCnt, trace->file);
+	}
+	fclose(trace->file);
+	pthread_cond_destroy(&trace->cond);
+	pthread_mutex_destroy(&trace->lock);
+	free(trace);
+}
+
+int ObjectTraceSampled(unsigned int sampleRate, unsigned int hash)
+{
+	// 用hash的高位采样，与决定桶位置的低位无关
+	return ((hash >> 16) * 0x9E3779B1U >> 8) % sampleRate == 0;
+}
+
+void ObjectTraceAppend(ObjectTrace *trace, unsigned int hash, int op,
+	unsigned int size, unsigned int expireTime)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+
+	ObjectTraceRecord *record = trace->active + trace->recordCnt;
+	record->timeStamps = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	record->keyHash = hash;
+	record->size = size;
+	record->expireTime = expireTime;
+	record->op = (uint8_t)op;
+	memset(record->reserved, 0, sizeof(record->reserved));
+
+	if (++trace->recordCnt == TRACE_BUF_CNT)
+	{
+		ObjectTraceSwap(trace);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef _OBJECT_TRACE_H
+#define _OBJECT_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * ObjectCache的访问记录
+ * 按key的hash值采样，采到的key的所有访问都会被记录，
+ * 记录先写入内存中的缓冲区，写满后与另一块缓冲区交换，由后台线程写入文件，
+ * 追加记录的线程不做文件IO；写线程还没写完上一块时，新写满的一块被丢弃
+ * ObjectTraceAppend由调用方串行化，ObjectCache在持有缓存的锁时调用
+ */
+#define OBJECT_TRACE_MAGIC "OCTRACE1"
+
+#define OBJECT_TRACE_GET_HIT 1
+#define OBJECT_TRACE_GET_MISS 2
+#define OBJECT_TRACE_INSERT 3
+
+typedef struct ObjectTraceHeader
+{
+	char magic[8];
+	uint32_t sampleRate;	// 采样率，每sampleRate个key中记录一个
+	uint32_t recordSize;	// 每条记录的字节数
+}ObjectTraceHeader;
+
+typedef struct ObjectTraceRecord
+{
+	uint64_t timeStamps;	// 访问时间(微秒)
+	uint32_t keyHash;		// key的hash值
+	uint32_t size;			// 对象的大小
+	uint32_t expireTime;	// 插入时指定的过期时间(秒)，查询时为0
+	uint8_t op;				// OBJECT_TRACE_*
+	uint8_t reserved[3];
+}ObjectTraceRecord;
+
+typedef struct ObjectTrace ObjectTrace;
+
+ObjectTrace* ObjectTraceCreate(const char *fileName, unsigned int sampleRate);
+void ObjectTraceDestory(ObjectTrace *trace);
+
+/*
+ * 只依赖采样率和hash，不访问trace，可以在不持有锁时调用
+ */
+int ObjectTraceSampled(unsigned int sampleRate, unsigned int hash);
+void ObjectTraceAppend(ObjectTrace *trace, unsigned int hash, int op,
+	unsigned int size, unsigned int expireTime);
+
+#endif
@@ -1,7 +1,10 @@
 #include <unistd.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "config_reader.h"
 #include "object_cache.h"
 
 #define TYPE_INT 1
@@ -41,8 +44,371 @@ void ReleaseObj(void *value, int typeID)
 	}
 }
 
-int main()
+static int serializeCnt = 0;
+
+int SerializeObj(const void *value, int typeID, char *buf, unsigned int bufLen)
+{
+	++serializeCnt;
+	unsigned int len = 0;
+	if (typeID == TYPE_INT)
+	{
+		len = sizeof(int);
+	}
+	else if (typeID == TYPE_DOUBLE)
+	{
+		len = sizeof(double);
+	}
+	else
+	{
+		return -1;
+	}
+
+	if (buf != NULL && bufLen >= len)
+	{
+		memcpy(buf, value, len);
+	}
+	return len;
+}
+
+void* DeserializeObj(const char *buf, unsigned int len, int typeID)
+{
+	// L2中的数据紧跟在key后面，不一定对齐
+	double value = 0;
+	if (len > sizeof(value))
+	{
+		return NULL;
+	}
+	memcpy(&value, buf, len);
+	return DumpObj(&value, typeID);
+}
+
+void TestSpill()
 {
+	int ret = ObjectCacheInit(2, DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	// 每条记录约48字节，16KB可以容纳所有被淘汰的对象
+	ret = ObjectCacheEnableSpill("./object_cache.spill", 16384, SerializeObj, DeserializeObj);
+	if (ret != 0)
+	{
+		printf("enable spill failed, ret[%d]\n", ret);
+		ObjectCacheDestory();
+		return;
+	}
+
+	char key[32] = {'\0'};
+	int i = 0;
+	for (i = 0; i < 100; ++i)
+	{
+		snprintf(key, sizeof(key), "spill%d", i);
+		ObjectCacheInsert(key, &i, TYPE_INT, 10);
+	}
+
+	// 内存和L2中都没有的key不会把内存中的对象挤到L2
+	// miss serialize 0
+	int lastSerializeCnt = serializeCnt;
+	for (i = 0; i < 10; ++i)
+	{
+		ObjectCacheGet("spill_none");
+	}
+	printf("miss serialize %d\n", serializeCnt - lastSerializeCnt);
+
+	// spill0 = 0
+	// spill50 = 50
+	// spill99 = 99
+	int keys[] = {0, 50, 99};
+	for (i = 0; i < 3; ++i)
+	{
+		snprintf(key, sizeof(key), "spill%d", keys[i]);
+		void *value = ObjectCacheGet(key);
+		if (value == NULL)
+		{
+			printf("%s no data\n", key);
+		}
+		else
+		{
+			printf("%s = %d\n", key, *(int*)value);
+		}
+	}
+
+	ObjectCacheSpillCompact();
+	ObjectCacheDestory();
+	unlink("./object_cache.spill");
+}
+
+static int lastSizeTypeID = 0;
+
+unsigned int SizeObj(const void *value, int typeID)
+{
+	lastSizeTypeID = typeID;
+	return typeID == TYPE_DOUBLE ? sizeof(double) : sizeof(int);
+}
+
+void TestFrontCache()
+{
+	int ret = ObjectCacheInit(16, DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	ObjectCacheEnableFrontCache();
+	int n = 1;
+	ObjectCacheInsert("front", &n, TYPE_INT, 10);
+	ObjectCacheGet("front");
+
+	// front = 1
+	void *value = ObjectCacheGet("front");
+	printf("front = %d\n", value == NULL ? -1 : *(int*)value);
+
+	// 修改后前端缓存失效
+	// front = 2
+	n = 2;
+	ObjectCacheInsert("front", &n, TYPE_INT, 10);
+	value = ObjectCacheGet("front");
+	printf("front = %d\n", value == NULL ? -1 : *(int*)value);
+
+	// 前端缓存命中时记录的访问使用对象本身的类型
+	// front trace type 2
+	double d = 1.5;
+	ObjectCacheInsert("frontDouble", &d, TYPE_DOUBLE, 10);
+	ObjectCacheGet("frontDouble");
+	ret = ObjectCacheTraceStart("./object_cache.trace", 1, SizeObj);
+	if (ret == 0)
+	{
+		ObjectCacheGet("frontDouble");
+		printf("front trace type %d\n", lastSizeTypeID);
+		ObjectCacheTraceStop();
+		unlink("./object_cache.trace");
+	}
+
+	ObjectCacheDestory();
+}
+
+void TestTrace()
+{
+	int ret = ObjectCacheInit(64, DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	ret = ObjectCacheTraceStart("./object_cache.trace", 1, NULL);
+	if (ret != 0)
+	{
+		printf("trace start failed, ret[%d]\n", ret);
+		ObjectCacheDestory();
+		return;
+	}
+
+	// 热点key和冷key混合访问
+	char key[32] = {'\0'};
+	int i = 0;
+	for (i = 0; i < 10000; ++i)
+	{
+		int k = (i % 3 == 0) ? rand() % 1000 : rand() % 32;
+		snprintf(key, sizeof(key), "trace%d", k);
+		if (ObjectCacheGet(key) == NULL)
+		{
+			ObjectCacheInsert(key, &k, TYPE_INT, 60);
+		}
+	}
+
+	ObjectCacheTraceStop();
+	ObjectCacheDestory();
+
+	// 回放: ../tools/cache_sim ./object_cache.trace
+	struct stat st;
+	if (stat("./object_cache.trace", &st) == 0)
+	{
+		printf("trace saved, %ld bytes\n", (long)st.st_size);
+	}
+	unlink("./object_cache.trace");
+}
+
+void PrintInt(const char *key)
+{
+	void *value = ObjectCacheGet(key);
+	if (value == NULL)
+	{
+		printf("%s no data\n", key);
+	}
+	else
+	{
+		printf("%s = %d\n", key, *(int*)value);
+	}
+}
+
+void PrintDouble(const char *key)
+{
+	void *value = ObjectCacheGet(key);
+	if (value == NULL)
+	{
+		printf("%s no data\n", key);
+	}
+	else
+	{
+		printf("%s = %lf\n", key, *(double*)value);
+	}
+}
+
+void TestInvalidate()
+{
+	int ret = ObjectCacheInit(16, DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	int n = 7;
+	double d = 7.5;
+	ObjectCacheInsert("invalidInt", &n, TYPE_INT, 10);
+	ObjectCacheInsert("invalidDouble", &d, TYPE_DOUBLE, 10);
+
+	// invalidInt no data
+	// invalidDouble = 7.500000
+	ObjectCacheInvalidateType(TYPE_INT);
+	PrintInt("invalidInt");
+	PrintDouble("invalidDouble");
+
+	// reclaim 1
+	// invalidDouble no data
+	ObjectCacheInvalidateAll();
+	printf("reclaim %u\n", ObjectCacheReclaim(64));
+	PrintDouble("invalidDouble");
+
+	ObjectCacheDestory();
+}
+
+int FlushObj(const char **keys, void **objs, const int *typeIDs, int count)
+{
+	int i = 0;
+	printf("flush %d:", count);
+	for (i = 0; i < count; ++i)
+	{
+		printf(" %s=%d", keys[i], *(int*)objs[i]);
+	}
+	printf("\n");
+	return 0;
+}
+
+int FailFlushObj(const char **keys, void **objs, const int *typeIDs, int count)
+{
+	return -1;
+}
+
+void TestWriteBehind()
+{
+	int ret = ObjectCacheInit(16, DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	// 延迟足够长，测试期间后台线程不会自行写出
+	ret = ObjectCacheEnableWriteBehind(FlushObj, 100, 10000);
+	if (ret != 0)
+	{
+		printf("enable write behind failed, ret[%d]\n", ret);
+		ObjectCacheDestory();
+		return;
+	}
+
+	// 同一个key只写出最后一次
+	// flush 2: wb1=3 wb2=1
+	int n = 1;
+	ObjectCacheInsert("wb1", &n, TYPE_INT, 10);
+	ObjectCacheInsert("wb2", &n, TYPE_INT, 10);
+	n = 3;
+	ObjectCacheInsert("wb1", &n, TYPE_INT, 10);
+	ObjectCacheFlush();
+
+	// 销毁前写出所有dirty数据
+	// flush 1: wb3=3
+	ObjectCacheInsert("wb3", &n, TYPE_INT, 10);
+	ObjectCacheDestory();
+
+	// 后端存储不可用时dirty数据不会被淘汰，缓存满后插入失败，销毁时丢弃
+	// insert wb3 ret[-1008]
+	// lost 2
+	ObjectCacheInit(2, DumpObj, ReleaseObj);
+	ObjectCacheEnableWriteBehind(FailFlushObj, 100, 10000);
+	ObjectCacheInsert("wb1", &n, TYPE_INT, 10);
+	ObjectCacheInsert("wb2", &n, TYPE_INT, 10);
+	ret = ObjectCacheInsert("wb3", &n, TYPE_INT, 10);
+	printf("insert wb3 ret[%d]\n", ret);
+	ObjectCacheDestory();
+	printf("lost %u\n", ObjectCacheFlushLost());
+}
+
+void TestConfig(const char *path)
+{
+	char configFile[256] = {'\0'};
+	snprintf(configFile, sizeof(configFile) - 1, "%s/test.ini", path);
+
+	int errNo = 0;
+	ConfigReader *reader = ConfigReaderCreate(configFile, &errNo);
+	if (reader == NULL)
+	{
+		printf("config reader create failed, errNo[%d]\n", errNo);
+		return;
+	}
+
+	int ret = ObjectCacheInitFromConfig(reader, "cache.sessions", DumpObj, ReleaseObj);
+	if (ret != 0)
+	{
+		printf("init local cache from config failed, ret[%d]\n", ret);
+		ConfigReaderDestory(reader);
+		return;
+	}
+
+	char key[32] = {'\0'};
+	int i = 0;
+	for (i = 0; i < 4; ++i)
+	{
+		snprintf(key, sizeof(key), "conf%d", i);
+		// 使用默认过期时间
+		ObjectCacheInsert(key, &i, TYPE_INT, 0);
+	}
+
+	// 缩小容量后只保留两个key
+	// conf remain 2
+	ObjectCacheApplyConfig(reader, "cache.sessions.tuned");
+	int remain = 0;
+	for (i = 0; i < 4; ++i)
+	{
+		snprintf(key, sizeof(key), "conf%d", i);
+		if (ObjectCacheGet(key) != NULL)
+		{
+			++remain;
+		}
+	}
+	printf("conf remain %d\n", remain);
+
+	// 超出unsigned int的配置不会被截断后使用
+	// apply overflow ret[-1003]
+	ret = ObjectCacheApplyConfig(reader, "cache.sessions.overflow");
+	printf("apply overflow ret[%d]\n", ret);
+
+	ObjectCacheDestory();
+	ConfigReaderDestory(reader);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[256] = {'\0'};
+	char *pc = strrchr(argv[0], '/');
+	memcpy(path, argv[0], pc - argv[0] + 1);
+	path[pc - argv[0] + 1] = '\0';
+
 	int ret = ObjectCacheInit(3, DumpObj, ReleaseObj);
 	if (ret != 0)
 	{
@@ -117,6 +483,13 @@ int main()
 	}
 
 	ObjectCacheDestory();
+
+	TestSpill();
+	TestFrontCache();
+	TestTrace();
+	TestInvalidate();
+	TestWriteBehind();
+	TestConfig(path);
 	
 	return 0;
 
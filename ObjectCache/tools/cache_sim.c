@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "object_cache.h"
+#include "object_trace.h"
+
+#define MAX_SETTINGS 64
+
+/*
+ * 回放ObjectCacheTraceStart记录的访问，计算不同容量和过期时间下的缺失率
+ * 用法: cache_sim [-c capacity]... [-t expireTime]... trace_file
+ * capacity为全量key的容量，会按采样率缩小后再回放；expireTime为0表示使用记录中的过期时间
+ */
+
+static time_t simNow = 0;
+static char simObj = 0;
+
+static time_t SimClock(time_t *now)
+{
+	if (now != NULL)
+	{
+		*now = simNow;
+	}
+	return simNow;
+}
+
+static void* SimDump(const void *obj, int typeID)
+{
+	return &simObj;
+}
+
+static void SimRelease(void *obj, int typeID)
+{
+}
+
+static ObjectTraceRecord* LoadTrace(const char *fileName, unsigned int *sampleRate, unsigned int *count)
+{
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	ObjectTraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		memcmp(header.magic, OBJECT_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.recordSize != sizeof(ObjectTraceRecord) || header.sampleRate == 0)
+	{
+		fclose(file);
+		return NULL;
+	}
+
+	unsigned int capacity = 4096;
+	unsigned int n = 0;
+	ObjectTraceRecord *records = (ObjectTraceRecord*)malloc(sizeof(ObjectTraceRecord) * capacity);
+	while (records != NULL)
+	{
+		n += fread(records + n, sizeof(ObjectTraceRecord), capacity - n, file);
+		if (n < capacity)
+		{
+			break;
+		}
+
+		capacity *= 2;
+		ObjectTraceRecord *tmp = (ObjectTraceRecord*)realloc(records, sizeof(ObjectTraceRecord) * capacity);
+		if (tmp == NULL)
+		{
+			free(records);
+		}
+		records = tmp;
+	}
+	fclose(file);
+
+	*sampleRate = header.sampleRate;
+	*count = n;
+	return records;
+}
+
+static int HashCmp(const void *x, const void *y)
+{
+	unsigned int a = *(const unsigned int*)x;
+	unsigned int b = *(const unsigned int*)y;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static unsigned int CountKeys(const ObjectTraceRecord *records, unsigned int count)
+{
+	unsigned int *hashs = (unsigned int*)malloc(sizeof(unsigned int) * (count + 1));
+	if (hashs == NULL)
+	{
+		return count;
+	}
+
+	unsigned int i = 0;
+	for (i = 0; i < count; ++i)
+	{
+		hashs[i] = records[i].keyHash;
+	}
+	qsort(hashs, count, sizeof(unsigned int), HashCmp);
+
+	unsigned int keys = 0;
+	for (i = 0; i < count; ++i)
+	{
+		if (i == 0 || hashs[i] != hashs[i - 1])
+		{
+			++keys;
+		}
+	}
+	free(hashs);
+	return keys;
+}
+
+static void Replay(const ObjectTraceRecord *records, unsigned int count,
+	unsigned int sampleRate, unsigned int capacity, unsigned int expireTime)
+{
+	unsigned int maxKeyCnt = capacity / sampleRate;
+	if (maxKeyCnt == 0)
+	{
+		maxKeyCnt = 1;
+	}
+
+	ObjectCacheSetClock(SimClock);
+	int ret = ObjectCacheInit(maxKeyCnt, SimDump, SimRelease);
+	if (ret != 0)
+	{
+		printf("init cache failed, ret[%d]\n", ret);
+		return;
+	}
+
+	unsigned long long gets = 0;
+	unsigned long long misses = 0;
+	char key[16] = {'\0'};
+	unsigned int i = 0;
+	for (i = 0; i < count; ++i)
+	{
+		const ObjectTraceRecord *record = records + i;
+		simNow = (time_t)(record->timeStamps / 1000000);
+		snprintf(key, sizeof(key), "%08x", record->keyHash);
+		if (record->op == OBJECT_TRACE_INSERT)
+		{
+			unsigned int ttl = expireTime > 0 ? expireTime : record->expireTime;
+			ObjectCacheInsert(key, &simObj, 0, ttl > 0 ? ttl : 1);
+		}
+		else
+		{
+			++gets;
+			if (ObjectCacheGet(key) == NULL)
+			{
+				++misses;
+			}
+		}
+	}
+	ObjectCacheDestory();
+
+	printf("%u\t%u\t%llu\t%llu\t%.4f\n", capacity, expireTime, gets, misses,
+		gets > 0 ? (double)misses / gets : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int capacitys[MAX_SETTINGS] = {0};
+	unsigned int expireTimes[MAX_SETTINGS] = {0};
+	int capacityCnt = 0;
+	int expireTimeCnt = 0;
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "c:t:")) != -1)
+	{
+		if (opt == 'c' && capacityCnt < MAX_SETTINGS)
+		{
+			capacitys[capacityCnt++] = strtoul(optarg, NULL, 10);
+		}
+		else if (opt == 't' && expireTimeCnt < MAX_SETTINGS)
+		{
+			expireTimes[expireTimeCnt++] = strtoul(optarg, NULL, 10);
+		}
+		else
+		{
+			printf("usage: %s [-c capacity]... [-t expireTime]... trace_file\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc)
+	{
+		printf("usage: %s [-c capacity]... [-t expireTime]... trace_file\n", argv[0]);
+		return 1;
+	}
+
+	unsigned int sampleRate = 0;
+	unsigned int count = 0;
+	ObjectTraceRecord *records = LoadTrace(argv[optind], &sampleRate, &count);
+	if (records == NULL)
+	{
+		printf("load trace %s failed\n", argv[optind]);
+		return 1;
+	}
+
+	if (capacityCnt == 0)
+	{
+		// 默认从16开始按2倍递增，直到能容纳记录中的所有key
+		unsigned int keys = CountKeys(records, count) * sampleRate;
+		unsigned int capacity = 16;
+		while (capacityCnt < MAX_SETTINGS)
+		{
+			capacitys[capacityCnt++] = capacity;
+			if (capacity >= keys)
+			{
+				break;
+			}
+			capacity *= 2;
+		}
+	}
+
+	if (expireTimeCnt == 0)
+	{
+		expireTimes[expireTimeCnt++] = 0;
+	}
+
+	printf("capacity\texpire\tgets\tmisses\tmiss_ratio\n");
+	int i = 0;
+	int j = 0;
+	for (j = 0; j < expireTimeCnt; ++j)
+	{
+		for (i = 0; i < capacityCnt; ++i)
+		{
+			Replay(records, count, sampleRate, capacitys[i], expireTimes[j]);
+		}
+	}
+
+	free(records);
+	return 0;
+}